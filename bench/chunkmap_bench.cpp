@@ -0,0 +1,106 @@
+// Compares the flat Morton-keyed ChunkMap against the std::set the renderer
+// used for chunk membership. Build with `make bench`.
+#include <chrono>
+#include <cstdio>
+#include <set>
+#include <vector>
+#include "../src/chunkmap.h"
+
+namespace {
+
+double nowMs() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Square block of chunks around the origin, in the order a spiral-out loader would add them
+std::vector<ChunkCoord> makeCoords(int count) {
+    std::vector<ChunkCoord> coords;
+    int side = 1;
+    while (side * side < count) {
+        ++side;
+    }
+    for (int x = -side / 2; coords.size() < static_cast<size_t>(count) && x < side - side / 2; ++x) {
+        for (int z = -side / 2; coords.size() < static_cast<size_t>(count) && z < side - side / 2; ++z) {
+            coords.push_back(std::make_pair(x, z));
+        }
+    }
+    return coords;
+}
+
+template <typename Insert, typename Lookup, typename Neighbours, typename Iterate>
+void run(const char* name, const std::vector<ChunkCoord>& coords, Insert insert, Lookup lookup, Neighbours neighbours, Iterate iterate) {
+    double start = nowMs();
+    for (const ChunkCoord& coord : coords) {
+        insert(coord);
+    }
+    double insertMs = nowMs() - start;
+
+    // Look everything up again, plus as many misses just outside the block
+    start = nowMs();
+    size_t found = 0;
+    for (const ChunkCoord& coord : coords) {
+        found += lookup(coord);
+        found += lookup(std::make_pair(coord.first + 1000000, coord.second));
+    }
+    double lookupMs = nowMs() - start;
+
+    start = nowMs();
+    size_t adjacent = 0;
+    for (const ChunkCoord& coord : coords) {
+        adjacent += neighbours(coord);
+    }
+    double neighbourMs = nowMs() - start;
+
+    start = nowMs();
+    long long sum = 0;
+    for (int pass = 0; pass < 10; ++pass) {
+        sum += iterate();
+    }
+    double iterateMs = (nowMs() - start) / 10.0;
+
+    std::printf("  %-9s insert %8.2f ms  lookup %8.2f ms  neighbours %8.2f ms  iterate %7.2f ms  (%zu %zu %lld)\n",
+                name, insertMs, lookupMs, neighbourMs, iterateMs, found, adjacent, sum);
+}
+
+} // namespace
+
+int main() {
+    for (int count : { 10000, 100000, 1000000 }) {
+        std::vector<ChunkCoord> coords = makeCoords(count);
+        std::printf("%d chunks\n", count);
+
+        std::set<ChunkCoord> set;
+        run("std::set", coords,
+            [&](const ChunkCoord& c) { set.insert(c); },
+            [&](const ChunkCoord& c) { return set.count(c); },
+            [&](const ChunkCoord& c) {
+                size_t n = 0;
+                for (int dx = -1; dx <= 1; ++dx)
+                    for (int dz = -1; dz <= 1; ++dz)
+                        n += (dx || dz) && set.count(std::make_pair(c.first + dx, c.second + dz));
+                return n;
+            },
+            [&]() {
+                long long sum = 0;
+                for (const ChunkCoord& c : set) sum += c.first + c.second;
+                return sum;
+            });
+
+        ChunkMap<int> map;
+        run("ChunkMap", coords,
+            [&](const ChunkCoord& c) { map[c] = 1; },
+            [&](const ChunkCoord& c) { return static_cast<size_t>(map.contains(c)); },
+            [&](const ChunkCoord& c) {
+                size_t n = 0;
+                map.forEachNeighbour(c, [&](const ChunkCoord&, int) { ++n; });
+                return n;
+            },
+            [&]() {
+                long long sum = 0;
+                map.forEach([&](const ChunkCoord& c, int) { sum += c.first + c.second; });
+                return sum;
+            });
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+// Flies a camera over voxelised hills and counts how many chunk faces the
+// renderer would submit with and without skipping back-facing face directions.
+// Build with `make bench`.
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "../src/chunkmesher.h"
+#include "../src/frustum.h"
+#include "../src/voxeliser.h"
+
+namespace {
+
+const int MAP_CHUNKS = 32; // Chunks along each edge of the map
+const int FRAMES = 600;
+
+struct MeshedChunk {
+    glm::vec3 boundsMin, boundsMax;
+    ChunkFaceRanges ranges;
+};
+
+// One lap of a circle around the middle of the map, looking along the path and down by pitch degrees
+void fly(const char* name, const std::vector<MeshedChunk>& chunks, float radius, float altitude, float pitch) {
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 400.0f);
+    float centre = MAP_CHUNKS * CHUNK_SIZE * 0.5f;
+    unsigned long long total = 0, submitted = 0;
+    for (int frame = 0; frame < FRAMES; ++frame) {
+        float angle = 6.2831853f * frame / FRAMES;
+        glm::vec3 eye(centre + radius * std::cos(angle), altitude, centre + radius * std::sin(angle));
+        glm::vec3 forward(-std::sin(angle) * std::cos(glm::radians(pitch)), -std::sin(glm::radians(pitch)), std::cos(angle) * std::cos(glm::radians(pitch)));
+        Frustum frustum;
+        frustum.update(projection * glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+        for (const MeshedChunk& chunk : chunks) {
+            if (!frustum.intersects(chunk.boundsMin, chunk.boundsMax)) {
+                continue;
+            }
+            unsigned int directions = frontFacingDirections(eye, chunk.boundsMin, chunk.boundsMax);
+            for (int face = 0; face < FACE_COUNT; ++face) {
+                int count = chunk.ranges.start[face + 1] - chunk.ranges.start[face];
+                total += count;
+                submitted += directions & (1u << face) ? count : 0;
+            }
+        }
+    }
+    std::printf("%-24s %9.0f faces/frame %9.0f submitted %6.1f%% skipped\n", name, double(total) / FRAMES, double(submitted) / FRAMES,
+                total ? 100.0 - 100.0 * submitted / total : 0.0);
+}
+
+} // namespace
+
+int main() {
+    // Rolling hills the full height of a chunk
+    HeightField field;
+    field.width = field.height = MAP_CHUNKS * CHUNK_SIZE;
+    field.heightScale = CHUNK_SIZE - 1;
+    for (int z = 0; z < field.height; ++z) {
+        for (int x = 0; x < field.width; ++x) {
+            field.samples.push_back(0.5f + 0.45f * std::sin(x * 0.05f) * std::cos(z * 0.07f));
+        }
+    }
+
+    std::vector<ChunkVoxels> voxels(MAP_CHUNKS * MAP_CHUNKS);
+    ChunkColumns columns;
+    for (int cz = 0; cz < MAP_CHUNKS; ++cz) {
+        for (int cx = 0; cx < MAP_CHUNKS; ++cx) {
+            buildColumns(field, std::make_pair(cx, cz), columns);
+            columnsToVoxels(columns, voxels[cz * MAP_CHUNKS + cx]);
+        }
+    }
+
+    std::vector<MeshedChunk> chunks;
+    FrameVector<ChunkVertex> vertices;
+    for (int cz = 0; cz < MAP_CHUNKS; ++cz) {
+        for (int cx = 0; cx < MAP_CHUNKS; ++cx) {
+            ChunkNeighbours neighbours;
+            for (int dz = -1; dz <= 1; ++dz) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    int nx = cx + dx, nz = cz + dz;
+                    if ((dx || dz) && nx >= 0 && nz >= 0 && nx < MAP_CHUNKS && nz < MAP_CHUNKS) {
+                        neighbours.voxels[neighbourIndex(dx, dz)] = &voxels[nz * MAP_CHUNKS + nx];
+                    }
+                }
+            }
+            MeshedChunk chunk;
+            vertices.clear();
+            meshChunk(voxels[cz * MAP_CHUNKS + cx], neighbours, vertices, chunk.ranges);
+            // Box around the solid voxels, as VoxelTree::chunkBounds gives the renderer
+            glm::vec3 origin(cx * CHUNK_SIZE, 0.0f, cz * CHUNK_SIZE);
+            chunk.boundsMin = glm::vec3(3.0e38f);
+            chunk.boundsMax = glm::vec3(-3.0e38f);
+            voxels[cz * MAP_CHUNKS + cx].forEachSolid([&](int x, int y, int z, BlockID) {
+                chunk.boundsMin = glm::min(chunk.boundsMin, origin + glm::vec3(x, y, z) - glm::vec3(0.5f));
+                chunk.boundsMax = glm::max(chunk.boundsMax, origin + glm::vec3(x, y, z) + glm::vec3(0.5f));
+            });
+            chunks.push_back(chunk);
+        }
+        frameArena().reset();
+    }
+
+    fly("high pass, looking down", chunks, 120.0f, 60.0f, 35.0f);
+    fly("low pass, level", chunks, 120.0f, 18.0f, 5.0f);
+    fly("skimming the hills", chunks, 80.0f, 12.0f, 0.0f);
+    return 0;
+}
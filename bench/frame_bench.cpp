@@ -0,0 +1,89 @@
+// Runs the CPU side of a frame the way render() does: the shader directory
+// polled for edits, occluders rasterised and chunk boxes tested on the worker
+// pool, then the survivors sorted in a render queue, all from the frame arena. Reports how many frames after warm-up
+// reached the general heap, which should be none. Build with `make bench`.
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "../src/framearena.h"
+#include "../src/occlusionculler.h"
+#include "../src/renderqueue.h"
+#include "../src/shaderwatcher.h"
+#include "../src/workerpool.h"
+
+namespace {
+
+const int GRID_CHUNKS = 33; // Chunks along each edge of the window
+const int CHUNK = 16;
+const int WARM_UP_FRAMES = 10;
+const int FRAMES = 600;
+
+} // namespace
+
+int main() {
+    WorkerPool workers;
+    workers.start();
+    OcclusionCuller culler;
+    frameArena().reserve(1024 * 1024);
+    ShaderWatcher watcher;
+    watcher.start("shaders");
+
+    // Chunk boxes with rolling heights, and a ridge of occluders across the middle
+    std::vector<glm::vec3> boundsMin, boundsMax;
+    for (int z = 0; z < GRID_CHUNKS; ++z) {
+        for (int x = 0; x < GRID_CHUNKS; ++x) {
+            float height = 4.0f + 8.0f * (1.0f + std::sin(x * 0.4f) * std::cos(z * 0.3f));
+            boundsMin.push_back(glm::vec3(x * CHUNK, 0.0f, z * CHUNK));
+            boundsMax.push_back(glm::vec3((x + 1) * CHUNK, height, (z + 1) * CHUNK));
+        }
+    }
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 1000.0f);
+    float centre = GRID_CHUNKS * CHUNK * 0.5f;
+    unsigned long long allocatingFrames = 0, allocations = 0, lastFrameAllocations = 0, drawn = 0;
+    for (int frame = 0; frame < WARM_UP_FRAMES + FRAMES; ++frame) {
+        frameArena().reset();
+        unsigned long long before = heapAllocationCount();
+        {
+            watcher.poll();
+
+            float angle = 6.2831853f * frame / FRAMES;
+            glm::vec3 eye(centre + 100.0f * std::cos(angle), 20.0f, centre + 100.0f * std::sin(angle));
+            glm::mat4 view = glm::lookAt(eye, glm::vec3(centre, 0.0f, centre), glm::vec3(0.0f, 1.0f, 0.0f));
+
+            culler.beginFrame(projection * view);
+            for (int x = 0; x < GRID_CHUNKS; ++x) {
+                culler.addBox(glm::vec3(x * CHUNK, 0.0f, centre - 4.0f), glm::vec3((x + 1) * CHUNK, 24.0f, centre + 4.0f));
+            }
+            culler.rasterise(workers);
+
+            int count = static_cast<int>(boundsMin.size());
+            FrameVector<unsigned char> visible(count);
+            culler.testBoxes(boundsMin.data(), boundsMax.data(), count, visible.data(), workers);
+
+            RenderQueue queue;
+            queue.reserve(count);
+            for (int i = 0; i < count; ++i) {
+                if (visible[i]) {
+                    float depth = glm::length(glm::clamp(eye, boundsMin[i], boundsMax[i]) - eye) / 1000.0f;
+                    queue.push(0, 0, 0, depth, static_cast<uint32_t>(i));
+                }
+            }
+            queue.sort();
+            drawn += queue.size();
+        }
+        if (frame >= WARM_UP_FRAMES) {
+            lastFrameAllocations = heapAllocationCount() - before;
+            allocations += lastFrameAllocations;
+            allocatingFrames += lastFrameAllocations != 0;
+        }
+    }
+    workers.stop();
+    watcher.stop();
+
+    std::printf("%d frames, %.0f of %d chunks drawn per frame\n", FRAMES, double(drawn) / (WARM_UP_FRAMES + FRAMES), GRID_CHUNKS * GRID_CHUNKS);
+    std::printf("%llu frames reached the heap (%llu allocations), last frame %llu allocations, arena high water %zu KB\n",
+                allocatingFrames, allocations, lastFrameAllocations, frameArena().highWater() / 1024);
+    return allocatingFrames == 0 ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+// Counts the meshes and vertices needed to draw everything within a growing
+// view radius, with every chunk at full resolution and with far chunks
+// replaced by downsampled LOD cells. Build with `make bench`.
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "../src/chunklod.h"
+#include "../src/chunkmesher.h"
+#include "../src/voxeliser.h"
+
+namespace {
+
+const int MAX_RADIUS = 64;                // Largest view radius measured, in chunks
+const int MAP_CHUNKS = 2 * MAX_RADIUS + 8; // Chunks along each edge of the map
+const int FULL_RADIUS = 8;                // Full resolution chunks around the camera with LOD on
+
+double nowMs() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+struct Totals {
+    long long draws = 0, vertices = 0;
+    double buildMs = 0.0;
+};
+
+} // namespace
+
+int main() {
+    // Rolling hills the full height of a chunk
+    HeightField field;
+    field.width = field.height = MAP_CHUNKS * CHUNK_SIZE;
+    field.heightScale = CHUNK_SIZE - 1;
+    for (int z = 0; z < field.height; ++z) {
+        for (int x = 0; x < field.width; ++x) {
+            field.samples.push_back(0.5f + 0.45f * std::sin(x * 0.05f) * std::cos(z * 0.07f));
+        }
+    }
+
+    // Every chunk at full resolution, meshed against its neighbours like the renderer does
+    double start = nowMs();
+    std::vector<ChunkVoxels> voxels(MAP_CHUNKS * MAP_CHUNKS);
+    ChunkColumns columns;
+    for (int cz = 0; cz < MAP_CHUNKS; ++cz) {
+        for (int cx = 0; cx < MAP_CHUNKS; ++cx) {
+            buildColumns(field, std::make_pair(cx, cz), columns);
+            columnsToVoxels(columns, voxels[cz * MAP_CHUNKS + cx]);
+        }
+    }
+    std::vector<int> chunkVertices(MAP_CHUNKS * MAP_CHUNKS);
+    ChunkFaceRanges ranges;
+    for (int cz = 0; cz < MAP_CHUNKS; ++cz) {
+        for (int cx = 0; cx < MAP_CHUNKS; ++cx) {
+            ChunkNeighbours neighbours;
+            for (int dz = -1; dz <= 1; ++dz) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    int nx = cx + dx, nz = cz + dz;
+                    if ((dx || dz) && nx >= 0 && nz >= 0 && nx < MAP_CHUNKS && nz < MAP_CHUNKS) {
+                        neighbours.voxels[neighbourIndex(dx, dz)] = &voxels[nz * MAP_CHUNKS + nx];
+                    }
+                }
+            }
+            {
+                FrameVector<ChunkVertex> vertices;
+                meshChunk(voxels[cz * MAP_CHUNKS + cx], neighbours, vertices, ranges);
+                chunkVertices[cz * MAP_CHUNKS + cx] = static_cast<int>(vertices.size());
+            }
+            frameArena().reset();
+        }
+    }
+    double chunkMs = (nowMs() - start) / (MAP_CHUNKS * MAP_CHUNKS);
+
+    ChunkCoord centre = std::make_pair(MAP_CHUNKS / 2, MAP_CHUNKS / 2);
+    std::printf("%6s %10s %12s %10s %12s %12s\n", "radius", "draws", "vertices", "lod draws", "lod vertices", "lod build ms");
+    for (int radius = FULL_RADIUS; radius <= MAX_RADIUS; radius *= 2) {
+        Totals full, lod;
+        for (int cz = centre.second - radius; cz <= centre.second + radius; ++cz) {
+            for (int cx = centre.first - radius; cx <= centre.first + radius; ++cx) {
+                ++full.draws;
+                full.vertices += chunkVertices[cz * MAP_CHUNKS + cx];
+            }
+        }
+
+        // LOD cells are meshed on their own, so their borders come out as skirts
+        std::vector<LodCell> selected;
+        {
+            FrameVector<LodCell> cells;
+            selectLodCells(centre, FULL_RADIUS, radius, MAX_LOD_LEVELS, cells);
+            selected.assign(cells.begin(), cells.end());
+        }
+        frameArena().reset();
+        for (const LodCell& cell : selected) {
+            ++lod.draws;
+            if (cell.level == 0) {
+                lod.vertices += chunkVertices[cell.cell.second * MAP_CHUNKS + cell.cell.first];
+                lod.buildMs += chunkMs;
+                continue;
+            }
+            double cellStart = nowMs();
+            ChunkVoxels cellVoxels;
+            buildLodVoxels(field, cell, cellVoxels);
+            {
+                FrameVector<ChunkVertex> vertices;
+                meshChunk(cellVoxels, ChunkNeighbours(), vertices, ranges);
+                lod.vertices += vertices.size();
+            }
+            lod.buildMs += nowMs() - cellStart;
+            frameArena().reset();
+        }
+        std::printf("%6d %10lld %12lld %10lld %12lld %12.1f\n", radius, full.draws, full.vertices, lod.draws, lod.vertices, lod.buildMs);
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+// Times VoxelTree ray casts over rolling terrain, the way picking uses them.
+// Build with `make bench`.
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "../src/voxeltree.h"
+
+namespace {
+
+double nowUs() {
+    using namespace std::chrono;
+    return duration<double, std::micro>(steady_clock::now().time_since_epoch()).count();
+}
+
+void run(const char* name, const VoxelTree& tree, const std::vector<VoxelRay>& rays) {
+    std::vector<VoxelRayHit> hits(rays.size());
+    double start = nowUs();
+    int found = tree.raycast(rays.data(), static_cast<int>(rays.size()), hits.data());
+    double us = nowUs() - start;
+    std::printf("%-28s %7zu rays %7d hits %8.3f us/ray\n", name, rays.size(), found, us / rays.size());
+}
+
+} // namespace
+
+int main() {
+    // 64x64 chunks of sine hills, 1024 voxels across
+    VoxelTree tree;
+    for (int cx = -32; cx < 32; ++cx) {
+        for (int cz = -32; cz < 32; ++cz) {
+            ChunkVoxels voxels;
+            for (int z = 0; z < CHUNK_SIZE; ++z) {
+                for (int x = 0; x < CHUNK_SIZE; ++x) {
+                    float wx = static_cast<float>(cx * CHUNK_SIZE + x), wz = static_cast<float>(cz * CHUNK_SIZE + z);
+                    int height = static_cast<int>(6.0f + 4.0f * std::sin(wx * 0.05f) * std::cos(wz * 0.07f));
+                    for (int y = 0; y <= height; ++y) {
+                        voxels.set(x, y, z, BLOCK_STONE);
+                    }
+                }
+            }
+            voxels.compact();
+            tree.update(std::make_pair(cx, cz), voxels);
+        }
+    }
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> random(-1.0f, 1.0f);
+    const int count = 100000;
+    std::vector<VoxelRay> rays;
+
+    // Looking down at the ground from above, like picking
+    for (int i = 0; i < count; ++i) {
+        glm::vec3 direction(random(rng), -0.5f + 0.4f * random(rng), random(rng));
+        rays.push_back({ glm::vec3(random(rng) * 100.0f, 20.0f, random(rng) * 100.0f), glm::normalize(direction), 256.0f });
+    }
+    run("picking", tree, rays);
+
+    // Nearly horizontal over the hills; most travel hundreds of voxels
+    rays.clear();
+    for (int i = 0; i < count; ++i) {
+        glm::vec3 direction(random(rng), -0.02f + 0.01f * random(rng), random(rng));
+        rays.push_back({ glm::vec3(random(rng) * 20.0f, 13.0f, random(rng) * 20.0f), glm::normalize(direction), 500.0f });
+    }
+    run("long range, grazing", tree, rays);
+
+    // Just over the highest hills without touching them, out to full range
+    rays.clear();
+    for (int i = 0; i < count; ++i) {
+        glm::vec3 direction(random(rng), 0.0f, random(rng));
+        rays.push_back({ glm::vec3(random(rng) * 20.0f, 15.2f, random(rng) * 20.0f), glm::normalize(direction), 500.0f });
+    }
+    run("long range, miss", tree, rays);
+    return 0;
+}
@@ -0,0 +1,8 @@
+#version 330 core
+
+out vec4 FragColor;
+
+// Colour writes are off while boxes are tested; only whether samples pass matters
+void main() {
+    FragColor = vec4(1.0);
+}
@@ -0,0 +1,16 @@
+#version 330 core
+
+layout(location = 0) in vec3 aPos; // Corner of the unit cube
+
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+};
+
+// World-space corners of the box being tested
+uniform vec3 boxMin;
+uniform vec3 boxMax;
+
+void main() {
+    gl_Position = projection * view * vec4(mix(boxMin, boxMax, aPos), 1.0);
+}
@@ -0,0 +1,13 @@
+#version 330 core
+
+in vec3 albedo;
+in float light;
+in vec4 outlineColor;
+
+out vec4 FragColor;
+
+uniform bool outline; // Flat outline colour instead of shading
+
+void main() {
+    FragColor = outline ? outlineColor : vec4(albedo * light, 1.0);
+}
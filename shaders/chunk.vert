@@ -0,0 +1,32 @@
+#version 330 core
+
+layout(location = 0) in uint aPacked; // Packed chunk vertex, see chunkmesher.h
+// Per draw, one element per instance picked by the draw's base instance
+layout(location = 1) in vec4 aOrigin;  // World position of corner (0, 0, 0); w is world units per voxel
+layout(location = 2) in vec4 aOutline; // Wireframe colour
+
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+};
+
+out vec3 albedo;
+out float light;
+out vec4 outlineColor;
+
+// Indexed by face direction: -X, +X, -Y, +Y, -Z, +Z
+const float FACE_LIGHT[6] = float[6](0.7, 0.7, 0.5, 1.0, 0.85, 0.85);
+// Indexed by block ID: air, stone, dirt, grass
+const vec3 MATERIAL_COLOR[4] = vec3[4](vec3(1.0, 0.0, 1.0), vec3(0.5, 0.5, 0.5), vec3(0.45, 0.3, 0.15), vec3(0.0, 0.5, 0.2));
+
+void main() {
+    vec3 corner = vec3(aPacked & 31u, (aPacked >> 5) & 31u, (aPacked >> 10) & 31u);
+    uint face = (aPacked >> 15) & 7u;
+    uint ao = (aPacked >> 18) & 3u;
+    uint material = (aPacked >> 20) & 255u;
+
+    albedo = MATERIAL_COLOR[min(material, 3u)];
+    light = FACE_LIGHT[face] * (0.4 + 0.2 * float(ao));
+    outlineColor = aOutline;
+    gl_Position = projection * view * vec4(aOrigin.xyz + corner * aOrigin.w, 1.0);
+}
@@ -1,12 +1,14 @@
 #version 330 core
 
 layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aOffset; // Per-instance cube position, (0, 0, 0) when not instanced
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+};
 
 void main() {
-    // Apply model, view, and projection transformations
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    // Apply instance offset, view, and projection transformations
+    gl_Position = projection * view * vec4(aPos + aOffset, 1.0);
 }
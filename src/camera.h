@@ -13,7 +13,10 @@ public:
     glm::vec3 Right;
     glm::vec3 WorldUp;
 
-    glm::vec3 currentSelected;
+    // Voxel under the crosshair and the normal of the face looked at, filled by the renderer
+    glm::vec3 currentSelected = glm::vec3(0.0f);
+    glm::vec3 selectedFace = glm::vec3(0.0f);
+    bool hasSelection = false;
 
     // Euler Angles
     float Yaw;
@@ -0,0 +1,41 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include "chunkcoord.h"
+#include "chunkvoxels.h"
+#include "chunkmesher.h"
+#include "meshpool.h"
+
+// Everything kept in memory for one chunk while it is resident
+struct Chunk {
+    ChunkCoord coord;
+
+    // Voxel data, palette compressed
+    ChunkVoxels voxels;
+    int solidFloor = 0; // Bottom layers solid in every column, used as an occluder
+
+    // Mesh: four packed vertices per visible face in the shared mesh pool, drawn with the shared quad index buffer
+    MeshPool::Allocation mesh;
+    GLsizei faceCount = 0;
+    ChunkFaceRanges faceRanges; // Quads of each face direction, so back-facing directions can be skipped
+    bool meshed = false;
+    unsigned short meshedNeighbours = 0; // Bit neighbourIndex() set for each neighbour the mesh saw
+    bool stale = false;                  // A neighbour arrived since meshing; borders and AO are out of date
+    FaceConnectivity connectivity = FACE_CONNECTIVITY_ALL; // Faces joined through air, found when meshing
+
+    unsigned long long lastUsedFrame = 0;
+    bool prefetched = false; // Built ahead of time by the prefetcher
+    bool drawn = false;      // Has been drawn at least once
+    bool released = false;   // Left the view window; evicted before anything else until used again
+
+    size_t cpuBytes() const { return sizeof(Chunk) - sizeof(ChunkVoxels) + voxels.memoryBytes(); }
+    size_t gpuBytes() const { return mesh.vertexCount * sizeof(ChunkVertex); }
+
+    void releaseMesh(MeshPool& pool) {
+        pool.free(mesh);
+        faceCount = 0;
+        meshed = false;
+        stale = false;
+    }
+};
@@ -0,0 +1,7 @@
+#pragma once
+#include <utility>
+
+#define CHUNK_SIZE 16 // Define the chunk size
+
+// Chunk column coordinates (x, z) in units of CHUNK_SIZE
+typedef std::pair<int, int> ChunkCoord;
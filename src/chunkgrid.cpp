@@ -0,0 +1,48 @@
+#include "chunkgrid.h"
+#include <algorithm>
+#include <cstdlib>
+
+void ChunkGrid::resize(int newRadius) {
+    radius = std::max(MIN_VIEW_RADIUS, std::min(MAX_VIEW_RADIUS, newRadius));
+    side = 2 * radius + 1;
+    slots.assign(side * side, ChunkCoord());
+
+    // Worst case is a jump to a window with no overlap
+    entering.clear();
+    leaving.clear();
+    entering.reserve(side * side);
+    leaving.reserve(side * side);
+    initialised = false;
+}
+
+int ChunkGrid::wrap(int value) const {
+    int slot = value % side;
+    return slot < 0 ? slot + side : slot;
+}
+
+void ChunkGrid::recenter(const ChunkCoord& newCentre) {
+    entering.clear();
+    leaving.clear();
+    if (initialised && newCentre == centre) {
+        return;
+    }
+
+    if (initialised) {
+        windowDifference(centre, newCentre, radius, leaving);
+        windowDifference(newCentre, centre, radius, entering);
+    } else {
+        // First use: the whole window enters
+        windowDifference(newCentre, std::make_pair(newCentre.first + side, newCentre.second), radius, entering);
+    }
+    centre = newCentre;
+    initialised = true;
+
+    // Each entering chunk is a window width from a leaving one, so it takes over that slot
+    for (const ChunkCoord& coord : entering) {
+        slots[wrap(coord.first) * side + wrap(coord.second)] = coord;
+    }
+}
+
+bool ChunkGrid::contains(const ChunkCoord& coord) const {
+    return initialised && std::abs(coord.first - centre.first) <= radius && std::abs(coord.second - centre.second) <= radius;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "chunkcoord.h"
+
+#define MIN_VIEW_RADIUS 8
+#define MAX_VIEW_RADIUS 32
+
+// Appends the chunks within radius of a (Chebyshev distance) that aren't within
+// radius of b, walking whole columns and the strips above and below b's window,
+// so the cost is proportional to what is appended
+template <typename Container>
+void windowDifference(const ChunkCoord& a, const ChunkCoord& b, int radius, Container& out) {
+    for (int x = a.first - radius; x <= a.first + radius; ++x) {
+        bool shared = x - b.first <= radius && b.first - x <= radius;
+        int belowEnd = shared ? std::min(a.second + radius, b.second - radius - 1) : a.second + radius;
+        for (int z = a.second - radius; z <= belowEnd; ++z) {
+            out.push_back(std::make_pair(x, z));
+        }
+        if (shared) {
+            for (int z = std::max(a.second - radius, b.second + radius + 1); z <= a.second + radius; ++z) {
+                out.push_back(std::make_pair(x, z));
+            }
+        }
+    }
+}
+
+// The square window of chunks around the camera chunk, stored as a toroidal
+// ring buffer: chunk (x, z) always lives in slot (x mod side, z mod side). When
+// the window moves, each entering chunk takes the slot of a leaving one, so an
+// update costs O(edge * distance moved) and never allocates.
+class ChunkGrid {
+public:
+    // Clamps the radius to [MIN_VIEW_RADIUS, MAX_VIEW_RADIUS]; the only call that allocates
+    void resize(int radius);
+    // Centres the window on the given chunk and fills entered() and left()
+    void recenter(const ChunkCoord& centre);
+
+    bool contains(const ChunkCoord& coord) const;
+    int getRadius() const { return radius; }
+    const ChunkCoord& getCentre() const { return centre; }
+
+    // Every chunk in the window, in slot order
+    const std::vector<ChunkCoord>& coords() const { return slots; }
+    // Chunks added and released by the last recenter(): the new window minus the old
+    // one and the old minus the new, so no chunk is in both
+    const std::vector<ChunkCoord>& entered() const { return entering; }
+    const std::vector<ChunkCoord>& left() const { return leaving; }
+
+private:
+    int wrap(int value) const;
+
+    int radius = 0;
+    int side = 0;
+    bool initialised = false;
+    ChunkCoord centre;
+    std::vector<ChunkCoord> slots;
+    std::vector<ChunkCoord> entering, leaving;
+};
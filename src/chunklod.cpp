@@ -0,0 +1,119 @@
+#include "chunklod.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+
+// Chebyshev distance in chunks from centre to the nearest and farthest chunk of [first, last]
+int nearest(int first, int last, int centre) { return std::max(0, std::max(first - centre, centre - last)); }
+int farthest(int first, int last, int centre) { return std::max(std::abs(first - centre), std::abs(last - centre)); }
+
+void selectCell(const ChunkCoord& centre, int fullRadius, int level, int x, int z, FrameVector<LodCell>& cells) {
+    int firstX = x << level, lastX = firstX + (1 << level) - 1;
+    int firstZ = z << level, lastZ = firstZ + (1 << level) - 1;
+    int reach = level > 0 ? fullRadius << (level - 1) : 0;
+    bool split = level > 0 && farthest(firstX, lastX, centre.first) <= reach && farthest(firstZ, lastZ, centre.second) <= reach;
+    if (!split) {
+        LodCell cell;
+        cell.level = level;
+        cell.cell = std::make_pair(x, z);
+        cells.push_back(cell);
+        return;
+    }
+    for (int dz = 0; dz < 2; ++dz) {
+        for (int dx = 0; dx < 2; ++dx) {
+            selectCell(centre, fullRadius, level - 1, x * 2 + dx, z * 2 + dz, cells);
+        }
+    }
+}
+
+} // namespace
+
+void selectLodCells(const ChunkCoord& centre, int fullRadius, int lodRadius, int levels, FrameVector<LodCell>& cells) {
+    // Arithmetic shifts round towards negative infinity, like the cells themselves
+    int size = 1 << levels;
+    int minX = (centre.first - lodRadius) >> levels, maxX = (centre.first + lodRadius) >> levels;
+    int minZ = (centre.second - lodRadius) >> levels, maxZ = (centre.second + lodRadius) >> levels;
+    for (int z = minZ; z <= maxZ; ++z) {
+        for (int x = minX; x <= maxX; ++x) {
+            if (nearest(x * size, x * size + size - 1, centre.first) <= lodRadius &&
+                nearest(z * size, z * size + size - 1, centre.second) <= lodRadius) {
+                selectCell(centre, fullRadius, levels, x, z, cells);
+            }
+        }
+    }
+}
+
+bool isFullResolution(const ChunkCoord& centre, int fullRadius, const ChunkCoord& chunk) {
+    int firstX = chunk.first & ~1, firstZ = chunk.second & ~1;
+    return farthest(firstX, firstX + 1, centre.first) <= fullRadius && farthest(firstZ, firstZ + 1, centre.second) <= fullRadius;
+}
+
+int buildLodVoxels(const HeightField& field, const LodCell& cell, ChunkVoxels& voxels) {
+    const int factor = 1 << cell.level;
+    const int layers = CHUNK_SIZE / factor;
+    const int columnsPerChunk = CHUNK_SIZE / factor; // LOD columns fed by one source chunk, per axis
+    const int volume = factor * factor * factor;
+    voxels.fill(BLOCK_AIR);
+
+    // factor divides CHUNK_SIZE, so the columns under one LOD column all come from one source chunk
+    ChunkColumns columns;
+    int topLayers = 0;
+    for (int sz = 0; sz < factor; ++sz) {
+        for (int sx = 0; sx < factor; ++sx) {
+            ChunkCoord source = std::make_pair(cell.cell.first * factor + sx, cell.cell.second * factor + sz);
+            buildColumns(field, source, columns);
+
+            for (int lz = 0; lz < columnsPerChunk; ++lz) {
+                for (int lx = 0; lx < columnsPerChunk; ++lx) {
+                    int solid[CHUNK_SIZE] = {};
+                    int topY[CHUNK_SIZE];
+                    BlockID topBlock[CHUNK_SIZE] = {};
+                    std::fill(topY, topY + layers, -1);
+
+                    // Count solid source voxels per layer and remember the highest one
+                    for (int z = lz * factor; z < (lz + 1) * factor; ++z) {
+                        for (int x = lx * factor; x < (lx + 1) * factor; ++x) {
+                            int i = z * CHUNK_SIZE + x;
+                            int y = 0;
+                            for (int r = columns.first[i]; r < columns.first[i + 1] && y < CHUNK_SIZE; ++r) {
+                                const ColumnRun& run = columns.runs[r];
+                                int end = std::min(CHUNK_SIZE, y + run.length);
+                                if (run.block != BLOCK_AIR) {
+                                    for (int layer = y / factor; layer * factor < end; ++layer) {
+                                        int overlap = std::min(end, (layer + 1) * factor) - std::max(y, layer * factor);
+                                        solid[layer] += overlap;
+                                        int top = std::min(end, (layer + 1) * factor) - 1;
+                                        if (top > topY[layer]) {
+                                            topY[layer] = top;
+                                            topBlock[layer] = run.block;
+                                        }
+                                    }
+                                }
+                                y = end;
+                            }
+                        }
+                    }
+
+                    // The top voxel takes the real surface block, even when that sat in a layer that didn't make the cut
+                    int x = sx * columnsPerChunk + lx, z = sz * columnsPerChunk + lz;
+                    BlockID surface = BLOCK_AIR;
+                    bool covered = false;
+                    for (int layer = layers - 1; layer >= 0; --layer) {
+                        bool filled = layer == 0 ? solid[layer] > 0 : solid[layer] * 2 >= volume;
+                        if (surface == BLOCK_AIR && solid[layer] > 0) {
+                            surface = topBlock[layer];
+                        }
+                        if (filled) {
+                            voxels.set(x, layer, z, covered ? topBlock[layer] : surface);
+                            topLayers = std::max(topLayers, layer + 1);
+                            covered = true;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    voxels.compact();
+    return topLayers;
+}
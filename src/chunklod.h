@@ -0,0 +1,68 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "chunkcoord.h"
+#include "chunkvoxels.h"
+#include "chunkmesher.h"
+#include "framearena.h"
+#include "meshpool.h"
+#include "voxeliser.h"
+
+#define MAX_LOD_LEVELS 3 // Coarsest cells cover 8x8 chunks, one voxel per 8x8x8
+
+// A square of (1 << level) chunks per side drawn as one chunk-sized mesh, each
+// voxel standing for (1 << level)^3 full resolution voxels. Cell (x, z) at
+// level k covers chunks [x << k, (x + 1) << k); level 0 is a plain chunk.
+struct LodCell {
+    int level = 0;
+    ChunkCoord cell;
+};
+
+// What is kept in memory for a LOD cell while it is in use
+struct LodChunk {
+    LodCell cell;
+    ChunkVoxels voxels; // Only the bottom CHUNK_SIZE >> level layers are used
+    glm::vec3 boundsMin, boundsMax;
+
+    MeshPool::Allocation mesh;
+    GLsizei faceCount = 0;
+    ChunkFaceRanges faceRanges;
+    bool meshed = false;
+    unsigned long long lastUsedFrame = 0;
+
+    size_t cpuBytes() const { return sizeof(LodChunk) - sizeof(ChunkVoxels) + voxels.memoryBytes(); }
+    size_t gpuBytes() const { return mesh.vertexCount * sizeof(ChunkVertex); }
+
+    float scale() const { return static_cast<float>(1 << cell.level); }
+    // World position of mesh corner (0, 0, 0)
+    glm::vec3 origin() const {
+        int chunks = 1 << cell.level;
+        return glm::vec3(cell.cell.first * chunks * CHUNK_SIZE, 0.0f, cell.cell.second * chunks * CHUNK_SIZE) - glm::vec3(0.5f);
+    }
+
+    void releaseMesh(MeshPool& pool) {
+        pool.free(mesh);
+        faceCount = 0;
+        meshed = false;
+    }
+};
+
+// Picks what to draw around the camera chunk as a quadtree: cells of the
+// coarsest level within lodRadius chunks are split while all of their chunks
+// lie within fullRadius << (level - 1), so full resolution chunks stay inside
+// the fullRadius window and every level covers a ring twice as wide as the one
+// inside it. Each ring then holds about the same number of cells, and draws
+// grow with the number of levels rather than the square of the distance.
+// Cells never overlap and leave no gaps.
+void selectLodCells(const ChunkCoord& centre, int fullRadius, int lodRadius, int levels, FrameVector<LodCell>& cells);
+
+// Whether selectLodCells with the same centre and fullRadius draws the chunk at
+// level 0: its level 1 cell is split, which happens exactly when that cell lies
+// within fullRadius. Only these chunks need voxelising.
+bool isFullResolution(const ChunkCoord& centre, int fullRadius, const ChunkCoord& chunk);
+
+// Downsamples the heightmap under a cell into its voxels. A voxel is solid when
+// most of the voxels it stands for are (the bottom layer when any is, so the
+// floor stays closed) and takes the block nearest the surface among them, so
+// grass stays on top. Returns the number of layers with anything solid.
+int buildLodVoxels(const HeightField& field, const LodCell& cell, ChunkVoxels& voxels);
@@ -0,0 +1,214 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "chunkcoord.h"
+
+// Interleaves the bits of the two chunk coordinates (Z-order), so chunks that
+// are close in space get close keys. Coordinates are offset into unsigned range
+// first so negative chunks work.
+inline uint64_t mortonEncode(int x, int z) {
+    auto spread = [](uint64_t v) {
+        v &= 0xffffffffull;
+        v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+        v = (v | (v << 8)) & 0x00ff00ff00ff00ffull;
+        v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0full;
+        v = (v | (v << 2)) & 0x3333333333333333ull;
+        v = (v | (v << 1)) & 0x5555555555555555ull;
+        return v;
+    };
+    uint64_t ux = static_cast<uint32_t>(x) ^ 0x80000000u;
+    uint64_t uz = static_cast<uint32_t>(z) ^ 0x80000000u;
+    return spread(ux) | (spread(uz) << 1);
+}
+
+inline ChunkCoord mortonDecode(uint64_t key) {
+    auto compact = [](uint64_t v) {
+        v &= 0x5555555555555555ull;
+        v = (v | (v >> 1)) & 0x3333333333333333ull;
+        v = (v | (v >> 2)) & 0x0f0f0f0f0f0f0f0full;
+        v = (v | (v >> 4)) & 0x00ff00ff00ff00ffull;
+        v = (v | (v >> 8)) & 0x0000ffff0000ffffull;
+        v = (v | (v >> 16)) & 0x00000000ffffffffull;
+        return v;
+    };
+    int x = static_cast<int>(static_cast<uint32_t>(compact(key)) ^ 0x80000000u);
+    int z = static_cast<int>(static_cast<uint32_t>(compact(key >> 1)) ^ 0x80000000u);
+    return std::make_pair(x, z);
+}
+
+// Open-addressing hash map from chunk coordinates to T, keyed by Morton code.
+// The table only holds keys and indices into dense coordinate and value arrays,
+// so iteration is a linear walk over packed entries and erase moves the last
+// entry into the gap. Probing is linear with backward-shift deletion, so there
+// are no tombstones. The low Morton bits pick the slot inside a hashed block,
+// which puts each 2x2 group of chunks on one cache line of the table and makes
+// neighbour lookups cheap. Pointers to values are invalidated by insert and erase.
+template <typename T>
+class ChunkMap {
+public:
+    ChunkMap() { rehash(16); }
+
+    size_t size() const { return values.size(); }
+    bool empty() const { return values.empty(); }
+
+    T* find(const ChunkCoord& coord) {
+        size_t slot = findSlot(mortonEncode(coord.first, coord.second));
+        return slot != NOT_FOUND ? &values[slots[slot].index] : nullptr;
+    }
+    const T* find(const ChunkCoord& coord) const { return const_cast<ChunkMap*>(this)->find(coord); }
+    bool contains(const ChunkCoord& coord) const { return find(coord) != nullptr; }
+
+    // Inserts a default-constructed value if the chunk isn't present yet
+    T& operator[](const ChunkCoord& coord) {
+        uint64_t key = mortonEncode(coord.first, coord.second);
+        size_t slot = findSlot(key);
+        if (slot != NOT_FOUND) {
+            return values[slots[slot].index];
+        }
+        if ((values.size() + 1) * 4 > slots.size() * 3) {
+            rehash(slots.size() * 2); // Keep the load factor under 0.75
+        }
+        slot = probeStart(key);
+        while (slots[slot].key != EMPTY) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot].key = key;
+        slots[slot].index = static_cast<uint32_t>(values.size());
+        coords.push_back(coord);
+        values.emplace_back();
+        return values.back();
+    }
+
+    bool erase(const ChunkCoord& coord) {
+        size_t slot = findSlot(mortonEncode(coord.first, coord.second));
+        if (slot == NOT_FOUND) {
+            return false;
+        }
+        uint32_t index = slots[slot].index;
+
+        // Shift following entries of the probe run back into the hole
+        size_t hole = slot;
+        for (size_t next = (hole + 1) & mask; slots[next].key != EMPTY; next = (next + 1) & mask) {
+            size_t home = probeStart(slots[next].key);
+            bool canMove = hole <= next ? (home <= hole || home > next) : (home <= hole && home > next);
+            if (canMove) {
+                slots[hole] = slots[next];
+                hole = next;
+            }
+        }
+        slots[hole].key = EMPTY;
+
+        // Fill the gap in the dense arrays with the last entry
+        uint32_t last = static_cast<uint32_t>(values.size() - 1);
+        if (index != last) {
+            coords[index] = coords[last];
+            values[index] = std::move(values[last]);
+            slots[findSlot(mortonEncode(coords[index].first, coords[index].second))].index = index;
+        }
+        coords.pop_back();
+        values.pop_back();
+        return true;
+    }
+
+    void clear() {
+        for (Slot& slot : slots) {
+            slot.key = EMPTY;
+        }
+        coords.clear();
+        values.clear();
+    }
+
+    void reserve(size_t chunks) {
+        size_t capacity = 16;
+        while (capacity * 3 < chunks * 4) {
+            capacity *= 2;
+        }
+        if (capacity > slots.size()) {
+            rehash(capacity);
+        }
+        coords.reserve(chunks);
+        values.reserve(chunks);
+    }
+
+    // Calls f(coord, value) for every chunk; a linear walk over the dense arrays
+    template <typename F>
+    void forEach(F f) {
+        for (size_t i = 0; i < values.size(); ++i) {
+            f(coords[i], values[i]);
+        }
+    }
+
+    template <typename F>
+    void forEach(F f) const {
+        for (size_t i = 0; i < values.size(); ++i) {
+            f(coords[i], values[i]);
+        }
+    }
+
+    // Calls f(coord, value) for each of the eight neighbours that are present
+    template <typename F>
+    void forEachNeighbour(const ChunkCoord& coord, F f) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            for (int dz = -1; dz <= 1; ++dz) {
+                ChunkCoord neighbour = std::make_pair(coord.first + dx, coord.second + dz);
+                T* value = (dx || dz) ? find(neighbour) : nullptr;
+                if (value) {
+                    f(neighbour, *value);
+                }
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    static constexpr uint64_t EMPTY = ~0ull; // Not a valid code: it would need x = z = INT_MAX
+    static constexpr size_t NOT_FOUND = ~size_t(0);
+    static constexpr int BLOCK_BITS = 2; // Morton bits kept as the offset inside a block: 2x2 chunks
+
+    size_t probeStart(uint64_t key) const {
+        // Dense areas give dense runs of Morton codes, which linear probing turns into
+        // long clusters; scramble the block number but keep the offset inside the block
+        uint64_t block = key >> BLOCK_BITS;
+        block ^= block >> 31;
+        block *= 0xbf58476d1ce4e5b9ull;
+        block ^= block >> 29;
+        uint64_t offset = key & ((1ull << BLOCK_BITS) - 1);
+        return static_cast<size_t>((block << BLOCK_BITS) | offset) & mask;
+    }
+
+    size_t findSlot(uint64_t key) const {
+        for (size_t slot = probeStart(key);; slot = (slot + 1) & mask) {
+            if (slots[slot].key == key) {
+                return slot;
+            }
+            if (slots[slot].key == EMPTY) {
+                return NOT_FOUND;
+            }
+        }
+    }
+
+    void rehash(size_t capacity) {
+        slots.assign(capacity, Slot{ EMPTY, 0 });
+        mask = capacity - 1;
+        for (size_t i = 0; i < coords.size(); ++i) {
+            size_t slot = probeStart(mortonEncode(coords[i].first, coords[i].second));
+            while (slots[slot].key != EMPTY) {
+                slot = (slot + 1) & mask;
+            }
+            slots[slot].key = mortonEncode(coords[i].first, coords[i].second);
+            slots[slot].index = static_cast<uint32_t>(i);
+        }
+    }
+
+    std::vector<Slot> slots;
+    std::vector<ChunkCoord> coords;
+    std::vector<T> values;
+    size_t mask = 0;
+};
@@ -0,0 +1,171 @@
+#include "chunkmesher.h"
+#include <algorithm>
+
+namespace {
+
+// Neighbour offset per face direction
+const int FACE_NORMALS[FACE_COUNT][3] = {
+    { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 },
+};
+
+// Corner offsets of each face's quad, counter-clockwise seen from outside
+const int FACE_CORNERS[FACE_COUNT][4][3] = {
+    { { 0, 0, 0 }, { 0, 0, 1 }, { 0, 1, 1 }, { 0, 1, 0 } },
+    { { 1, 0, 0 }, { 1, 1, 0 }, { 1, 1, 1 }, { 1, 0, 1 } },
+    { { 0, 0, 0 }, { 1, 0, 0 }, { 1, 0, 1 }, { 0, 0, 1 } },
+    { { 0, 1, 0 }, { 0, 1, 1 }, { 1, 1, 1 }, { 1, 1, 0 } },
+    { { 0, 0, 0 }, { 0, 1, 0 }, { 1, 1, 0 }, { 1, 0, 0 } },
+    { { 0, 0, 1 }, { 1, 0, 1 }, { 1, 1, 1 }, { 0, 1, 1 } },
+};
+
+// Solid flags for a chunk plus a one-voxel border taken from its neighbours
+struct PaddedSolids {
+    static const int SIDE = CHUNK_SIZE + 2;
+    unsigned char solid[SIDE * SIDE * SIDE] = {};
+
+    static int index(int x, int y, int z) { return ((y + 1) * SIDE + (z + 1)) * SIDE + (x + 1); }
+    bool at(int x, int y, int z) const { return solid[index(x, y, z)] != 0; }
+    void set(int x, int y, int z) { solid[index(x, y, z)] = 1; }
+};
+
+// 0 (darkest) to 3 (open) from the voxels touching a corner in front of the face
+int vertexAO(bool side1, bool side2, bool corner) {
+    if (side1 && side2) {
+        return 0; // The corner voxel can't be seen, the two sides already close it off
+    }
+    return 3 - (side1 + side2 + corner);
+}
+
+} // namespace
+
+void meshChunk(const ChunkVoxels& voxels, const ChunkNeighbours& neighbours, FrameVector<ChunkVertex>& vertices, ChunkFaceRanges& ranges) {
+    // Gather occupancy once so face and AO tests are plain lookups. Above and
+    // below the chunk is always air.
+    PaddedSolids padded;
+    voxels.forEachSolid([&](int x, int y, int z, BlockID) { padded.set(x, y, z); });
+    for (int dz = -1; dz <= 1; ++dz) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            const ChunkVoxels* neighbour = neighbours.voxels[neighbourIndex(dx, dz)];
+            if ((dx == 0 && dz == 0) || !neighbour || neighbour->isEmpty()) {
+                continue;
+            }
+            // The strip of the neighbour that borders this chunk
+            int x0 = dx < 0 ? -1 : (dx > 0 ? CHUNK_SIZE : 0);
+            int x1 = dx < 0 ? -1 : (dx > 0 ? CHUNK_SIZE : CHUNK_SIZE - 1);
+            int z0 = dz < 0 ? -1 : (dz > 0 ? CHUNK_SIZE : 0);
+            int z1 = dz < 0 ? -1 : (dz > 0 ? CHUNK_SIZE : CHUNK_SIZE - 1);
+            for (int y = 0; y < CHUNK_SIZE; ++y) {
+                for (int z = z0; z <= z1; ++z) {
+                    for (int x = x0; x <= x1; ++x) {
+                        if (neighbour->get(x - dx * CHUNK_SIZE, y, z - dz * CHUNK_SIZE) != BLOCK_AIR) {
+                            padded.set(x, y, z);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    voxels.forEachSolid([&](int x, int y, int z, BlockID block) {
+        for (int face = 0; face < FACE_COUNT; ++face) {
+            const int* normal = FACE_NORMALS[face];
+            int fx = x + normal[0], fy = y + normal[1], fz = z + normal[2];
+            if (padded.at(fx, fy, fz)) {
+                continue;
+            }
+
+            // Sample the layer in front of the face, stepping towards each corner
+            // along the two axes the face spans
+            int u = normal[0] != 0 ? 1 : 0;
+            int v = normal[2] != 0 ? 1 : 2;
+            int ao[4];
+            for (int i = 0; i < 4; ++i) {
+                const int* corner = FACE_CORNERS[face][i];
+                int su[3] = { 0, 0, 0 }, sv[3] = { 0, 0, 0 };
+                su[u] = corner[u] * 2 - 1;
+                sv[v] = corner[v] * 2 - 1;
+                bool side1 = padded.at(fx + su[0], fy + su[1], fz + su[2]);
+                bool side2 = padded.at(fx + sv[0], fy + sv[1], fz + sv[2]);
+                bool diagonal = padded.at(fx + su[0] + sv[0], fy + su[1] + sv[1], fz + su[2] + sv[2]);
+                ao[i] = vertexAO(side1, side2, diagonal);
+            }
+
+            // Split along the darker diagonal; rotating the quad by one vertex
+            // moves the shared edge from 0-2 to 1-3 and keeps the winding
+            int first = ao[0] + ao[2] > ao[1] + ao[3] ? 1 : 0;
+            for (int i = 0; i < 4; ++i) {
+                int k = (first + i) % 4;
+                const int* corner = FACE_CORNERS[face][k];
+                vertices.push_back(packChunkVertex(x + corner[0], y + corner[1], z + corner[2], face, ao[k], block));
+            }
+        }
+    });
+
+    // Group the quads by direction with a counting sort, keeping their order within each direction
+    int counts[FACE_COUNT] = {};
+    for (size_t quad = 0; quad < vertices.size(); quad += 4) {
+        ++counts[vertices[quad] >> 15 & 7];
+    }
+    ranges.start[0] = 0;
+    for (int face = 0; face < FACE_COUNT; ++face) {
+        ranges.start[face + 1] = static_cast<uint16_t>(ranges.start[face] + counts[face]);
+    }
+    FrameVector<ChunkVertex> unsorted(vertices.begin(), vertices.end());
+    int next[FACE_COUNT];
+    for (int face = 0; face < FACE_COUNT; ++face) {
+        next[face] = ranges.start[face] * 4;
+    }
+    for (size_t quad = 0; quad < unsorted.size(); quad += 4) {
+        int& at = next[unsorted[quad] >> 15 & 7];
+        std::copy(unsorted.begin() + quad, unsorted.begin() + quad + 4, vertices.begin() + at);
+        at += 4;
+    }
+}
+
+FaceConnectivity faceConnectivity(const ChunkVoxels& voxels) {
+    if (voxels.isEmpty()) {
+        return FACE_CONNECTIVITY_ALL;
+    }
+
+    // Index (y * CHUNK_SIZE + z) * CHUNK_SIZE + x; solid voxels start out as already filled
+    const int volume = ChunkVoxels::VOLUME;
+    unsigned char filled[volume] = {};
+    voxels.forEachSolid([&](int x, int y, int z, BlockID) { filled[(y * CHUNK_SIZE + z) * CHUNK_SIZE + x] = 1; });
+
+    FaceConnectivity connectivity = 0;
+    uint16_t stack[volume];
+    for (int start = 0; start < volume; ++start) {
+        if (filled[start]) {
+            continue;
+        }
+        // One air region: collect the faces it touches
+        unsigned int faces = 0;
+        int depth = 0;
+        stack[depth++] = static_cast<uint16_t>(start);
+        filled[start] = 1;
+        while (depth) {
+            int index = stack[--depth];
+            int x = index % CHUNK_SIZE, z = index / CHUNK_SIZE % CHUNK_SIZE, y = index / (CHUNK_SIZE * CHUNK_SIZE);
+            int position[3] = { x, y, z };
+            for (int face = 0; face < FACE_COUNT; ++face) {
+                int axis = face / 2;
+                int next = position[axis] + FACE_NORMALS[face][axis];
+                if (next < 0 || next >= CHUNK_SIZE) {
+                    faces |= 1u << face;
+                    continue;
+                }
+                int neighbour = index + FACE_NORMALS[face][0] + FACE_NORMALS[face][2] * CHUNK_SIZE + FACE_NORMALS[face][1] * CHUNK_SIZE * CHUNK_SIZE;
+                if (!filled[neighbour]) {
+                    filled[neighbour] = 1;
+                    stack[depth++] = static_cast<uint16_t>(neighbour);
+                }
+            }
+        }
+        for (int a = 0; a < FACE_COUNT; ++a) {
+            if (faces & (1u << a)) {
+                connectivity |= static_cast<FaceConnectivity>(faces) << (a * FACE_COUNT);
+            }
+        }
+    }
+    return connectivity;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+#include "chunkvoxels.h"
+#include "framearena.h"
+
+// Chunk vertices are packed into a single 32-bit word, unpacked in chunk.vert:
+//   bits  0-4   x corner, 0..16
+//   bits  5-9   y corner
+//   bits 10-14  z corner
+//   bits 15-17  face direction
+//   bits 18-19  ambient occlusion, 0 darkest to 3 unoccluded
+//   bits 20-27  material (the block ID)
+// Corner c sits at c - 0.5 in chunk space since voxels are centred on integers;
+// the chunk's world origin is supplied per draw.
+typedef uint32_t ChunkVertex;
+
+enum FaceDirection { FACE_NEG_X = 0, FACE_POS_X, FACE_NEG_Y, FACE_POS_Y, FACE_NEG_Z, FACE_POS_Z, FACE_COUNT };
+
+#define MAX_CHUNK_FACES (ChunkVoxels::VOLUME * FACE_COUNT / 2) // A 3D checkerboard, every face exposed
+
+inline ChunkVertex packChunkVertex(int x, int y, int z, int face, int ao, int material) {
+    return static_cast<ChunkVertex>(x | y << 5 | z << 10 | face << 15 | ao << 18 | (material & 0xFF) << 20);
+}
+
+// Slot of the chunk at offset (dx, dz) in a 3x3 neighbourhood; 4 is the chunk itself
+inline int neighbourIndex(int dx, int dz) { return (dz + 1) * 3 + (dx + 1); }
+
+// The voxels of the eight chunks around the one being meshed, indexed by
+// neighbourIndex(); nullptr where a neighbour isn't loaded, which reads as air
+struct ChunkNeighbours {
+    const ChunkVoxels* voxels[9] = {};
+};
+
+// Quads of one face direction are stored together: direction d is quads [start[d], start[d + 1])
+struct ChunkFaceRanges {
+    uint16_t start[FACE_COUNT + 1] = {};
+};
+
+// Directions whose faces can point at the eye, as bits 1 << FaceDirection, for
+// faces inside the given box. The rest are back faces wherever they are.
+inline unsigned int frontFacingDirections(const glm::vec3& eye, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+    unsigned int directions = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        directions |= (eye[axis] < boundsMax[axis] ? 1u : 0u) << (axis * 2);
+        directions |= (eye[axis] > boundsMin[axis] ? 1u : 0u) << (axis * 2 + 1);
+    }
+    return directions;
+}
+
+// Emits four vertices per face open to air, counter-clockwise from outside, to
+// be drawn with the shared quad index buffer (0 1 2, 0 2 3 per quad). Each
+// vertex gets the classic voxel AO from the two sides and the corner next to
+// it, and quads are rotated so they split along the diagonal that keeps the
+// AO gradient symmetric. Quads are grouped by face direction into ranges.
+void meshChunk(const ChunkVoxels& voxels, const ChunkNeighbours& neighbours, FrameVector<ChunkVertex>& vertices, ChunkFaceRanges& ranges);
+
+// Which faces of a chunk can see each other through its air: bit a * FACE_COUNT + b
+// is set when an air region touches both face a and face b. Bit a * FACE_COUNT + a
+// means face a has any air on it at all.
+typedef uint64_t FaceConnectivity;
+const FaceConnectivity FACE_CONNECTIVITY_ALL = (1ull << (FACE_COUNT * FACE_COUNT)) - 1;
+
+inline bool facesConnected(FaceConnectivity connectivity, int a, int b) { return (connectivity >> (a * FACE_COUNT + b)) & 1; }
+
+// Flood fills the chunk's air to find which faces connect; done with each mesh build
+FaceConnectivity faceConnectivity(const ChunkVoxels& voxels);
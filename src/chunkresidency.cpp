@@ -0,0 +1,193 @@
+#include "chunkresidency.h"
+#include "framearena.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+void ChunkResidency::setBudgets(size_t cpuBytes, size_t gpuBytes) {
+    cpuBudget = cpuBytes;
+    gpuBudget = gpuBytes;
+}
+
+Chunk* ChunkResidency::acquire(const ChunkCoord& coord, unsigned long long frame) {
+    Chunk* chunk = find(coord, frame);
+    if (chunk) {
+        ++residencyStats.hits;
+    } else {
+        ++residencyStats.misses;
+    }
+    return chunk;
+}
+
+Chunk* ChunkResidency::find(const ChunkCoord& coord, unsigned long long frame) {
+    Chunk* chunk = chunks.find(coord);
+    if (chunk) {
+        chunk->lastUsedFrame = frame;
+        chunk->released = false;
+    }
+    return chunk;
+}
+
+void ChunkResidency::release(const ChunkCoord& coord) {
+    if (Chunk* chunk = chunks.find(coord)) {
+        chunk->released = true;
+    }
+}
+
+Chunk& ChunkResidency::insert(Chunk&& chunk, unsigned long long frame) {
+    chunk.lastUsedFrame = frame;
+    if (Chunk* previous = chunks.find(chunk.coord)) {
+        residencyStats.cpuBytes -= previous->cpuBytes();
+        residencyStats.gpuBytes -= previous->gpuBytes();
+        previous->releaseMesh(*meshPool);
+    }
+    Chunk& resident = chunks[chunk.coord];
+    resident = std::move(chunk);
+    residencyStats.cpuBytes += resident.cpuBytes();
+    residencyStats.gpuBytes += resident.gpuBytes();
+    residencyStats.residentChunks = chunks.size();
+    return resident;
+}
+
+bool ChunkResidency::setMesh(Chunk& chunk, const ChunkVertex* vertices, GLsizei count) {
+    residencyStats.gpuBytes -= chunk.gpuBytes();
+    chunk.releaseMesh(*meshPool);
+    bool uploaded = count == 0 || meshPool->allocate(vertices, count, chunk.mesh);
+    residencyStats.gpuBytes += chunk.gpuBytes();
+    return uploaded;
+}
+
+LodChunk* ChunkResidency::findLod(const LodCell& cell, unsigned long long frame) {
+    LodChunk* lod = lods[cell.level - 1].find(cell.cell);
+    if (lod) {
+        lod->lastUsedFrame = frame;
+    }
+    return lod;
+}
+
+LodChunk& ChunkResidency::insertLod(LodChunk&& lod, unsigned long long frame) {
+    ChunkMap<LodChunk>& level = lods[lod.cell.level - 1];
+    lod.lastUsedFrame = frame;
+    if (LodChunk* previous = level.find(lod.cell.cell)) {
+        residencyStats.cpuBytes -= previous->cpuBytes();
+        residencyStats.gpuBytes -= previous->gpuBytes();
+        previous->releaseMesh(*meshPool);
+    } else {
+        ++residencyStats.residentLodCells;
+    }
+    LodChunk& resident = level[lod.cell.cell];
+    resident = std::move(lod);
+    residencyStats.cpuBytes += resident.cpuBytes();
+    residencyStats.gpuBytes += resident.gpuBytes();
+    return resident;
+}
+
+bool ChunkResidency::setLodMesh(LodChunk& lod, const ChunkVertex* vertices, GLsizei count) {
+    residencyStats.cpuBytes -= lod.cpuBytes();
+    residencyStats.gpuBytes -= lod.gpuBytes();
+    lod.releaseMesh(*meshPool);
+    lod.voxels = ChunkVoxels();
+    bool uploaded = count == 0 || meshPool->allocate(vertices, count, lod.mesh);
+    residencyStats.cpuBytes += lod.cpuBytes();
+    residencyStats.gpuBytes += lod.gpuBytes();
+    return uploaded;
+}
+
+void ChunkResidency::trim(const glm::vec3& cameraPosition, unsigned long long frame) {
+    evictedChunks.clear();
+    size_t& cpuBytes = residencyStats.cpuBytes;
+    size_t& gpuBytes = residencyStats.gpuBytes;
+    if (cpuBytes <= cpuBudget && gpuBytes <= gpuBudget) {
+        return;
+    }
+
+    // Released chunks and unselected LOD cells go first; within each group the score is
+    // frames since last use, scaled up by distance in chunks from the camera
+    struct Candidate {
+        bool released;
+        float score;
+        int level; // 0 for a chunk
+        ChunkCoord coord;
+    };
+    auto score = [&](const ChunkCoord& coord, int level, unsigned long long lastUsedFrame) {
+        float size = static_cast<float>(CHUNK_SIZE << level);
+        float dx = (coord.first + 0.5f) * size - cameraPosition.x;
+        float dz = (coord.second + 0.5f) * size - cameraPosition.z;
+        float distance = std::sqrt(dx * dx + dz * dz) / CHUNK_SIZE;
+        return static_cast<float>(frame - lastUsedFrame) * (1.0f + distance);
+    };
+    FrameVector<Candidate> candidates;
+    candidates.reserve(chunks.size() + residencyStats.residentLodCells);
+    chunks.forEach([&](const ChunkCoord& coord, const Chunk& chunk) {
+        if (chunk.lastUsedFrame != frame) {
+            Candidate candidate = { chunk.released, score(coord, 0, chunk.lastUsedFrame), 0, coord };
+            candidates.push_back(candidate);
+        }
+    });
+    for (int level = 1; level <= MAX_LOD_LEVELS; ++level) {
+        lods[level - 1].forEach([&](const ChunkCoord& coord, const LodChunk& lod) {
+            if (lod.lastUsedFrame != frame) {
+                Candidate candidate = { true, score(coord, level, lod.lastUsedFrame), level, coord };
+                candidates.push_back(candidate);
+            }
+        });
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.released != b.released ? a.released : a.score > b.score;
+    });
+
+    for (const Candidate& candidate : candidates) {
+        if (cpuBytes <= cpuBudget && gpuBytes <= gpuBudget) {
+            break;
+        }
+        if (candidate.level == 0) {
+            evict(candidate.coord);
+        } else {
+            LodCell cell;
+            cell.level = candidate.level;
+            cell.cell = candidate.coord;
+            evictLod(cell);
+        }
+    }
+    residencyStats.residentChunks = chunks.size();
+}
+
+void ChunkResidency::evict(const ChunkCoord& coord) {
+    Chunk* chunk = chunks.find(coord);
+    if (!chunk) {
+        return;
+    }
+    residencyStats.cpuBytes -= chunk->cpuBytes();
+    residencyStats.gpuBytes -= chunk->gpuBytes();
+    if (chunk->prefetched && !chunk->drawn) {
+        ++residencyStats.wastedPrefetches;
+    }
+    chunk->releaseMesh(*meshPool);
+    chunks.erase(coord);
+    evictedChunks.push_back(coord);
+    ++residencyStats.evictions;
+}
+
+void ChunkResidency::evictLod(const LodCell& cell) {
+    LodChunk* lod = lods[cell.level - 1].find(cell.cell);
+    if (!lod) {
+        return;
+    }
+    residencyStats.cpuBytes -= lod->cpuBytes();
+    residencyStats.gpuBytes -= lod->gpuBytes();
+    lod->releaseMesh(*meshPool);
+    lods[cell.level - 1].erase(cell.cell);
+    --residencyStats.residentLodCells;
+    ++residencyStats.lodEvictions;
+}
+
+void ChunkResidency::clear() {
+    chunks.forEach([this](const ChunkCoord&, Chunk& chunk) { chunk.releaseMesh(*meshPool); });
+    chunks.clear();
+    for (ChunkMap<LodChunk>& level : lods) {
+        level.forEach([this](const ChunkCoord&, LodChunk& lod) { lod.releaseMesh(*meshPool); });
+        level.clear();
+    }
+    evictedChunks.clear();
+    residencyStats.cpuBytes = residencyStats.gpuBytes = residencyStats.residentChunks = residencyStats.residentLodCells = 0;
+}
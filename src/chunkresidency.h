@@ -0,0 +1,76 @@
+#pragma once
+#include <glm/glm.hpp>
+#include "chunk.h"
+#include "chunklod.h"
+#include "chunkmap.h"
+#include <vector>
+
+struct ResidencyStats {
+    unsigned long long hits = 0;
+    unsigned long long misses = 0;
+    unsigned long long evictions = 0;
+    unsigned long long lodEvictions = 0; // LOD cells, not included in evictions
+    unsigned long long wastedPrefetches = 0; // Prefetched chunks evicted without ever being drawn
+    size_t cpuBytes = 0; // Running totals of the resident chunks
+    size_t gpuBytes = 0;
+    size_t residentChunks = 0;
+    size_t residentLodCells = 0;
+};
+
+// Keeps built chunks around after they leave view so coming back is free.
+// Memory is bounded by CPU and GPU byte budgets; when either is exceeded the
+// least recently used chunks are evicted, weighted so far-away chunks go first.
+// LOD cells count against the same budgets; one that isn't selected this frame
+// is treated like a released chunk.
+class ChunkResidency {
+public:
+    void setBudgets(size_t cpuBytes, size_t gpuBytes);
+    // Where evicted chunks give their meshes back
+    void setMeshPool(MeshPool& pool) { meshPool = &pool; }
+
+    // Returns the resident chunk (a hit) or nullptr (a miss) and marks it used this frame
+    Chunk* acquire(const ChunkCoord& coord, unsigned long long frame);
+    // Returns the resident chunk and marks it used this frame, without counting a hit or miss
+    Chunk* find(const ChunkCoord& coord, unsigned long long frame);
+    // Look a chunk up without counting it as a hit or miss or marking it used
+    bool contains(const ChunkCoord& coord) const { return chunks.contains(coord); }
+    Chunk* peek(const ChunkCoord& coord) { return chunks.find(coord); }
+    // Takes ownership of a newly built chunk. Chunk pointers stay valid until the next insert() or trim().
+    Chunk& insert(Chunk&& chunk, unsigned long long frame);
+    // Replaces a resident chunk's mesh with count vertices; false if the pool couldn't fit them.
+    // Meshes must change through here so the GPU byte total stays right.
+    bool setMesh(Chunk& chunk, const ChunkVertex* vertices, GLsizei count);
+    // Marks a chunk that left the view window as the first to go when a budget is
+    // exceeded. It stays resident until then, so coming straight back is still free.
+    void release(const ChunkCoord& coord);
+    // The LOD cell if it has been built, marked as selected this frame
+    LodChunk* findLod(const LodCell& cell, unsigned long long frame);
+    // Takes ownership of a newly voxelised LOD cell, replacing any older copy
+    LodChunk& insertLod(LodChunk&& lod, unsigned long long frame);
+    // Replaces a LOD cell's mesh and drops its voxels, which are only needed to build it;
+    // false if the pool couldn't fit the vertices
+    bool setLodMesh(LodChunk& lod, const ChunkVertex* vertices, GLsizei count);
+
+    // Evicts chunks and LOD cells until both budgets are met, released ones first. Chunks used this frame are never evicted.
+    // Only walks the chunks when a budget is exceeded.
+    void trim(const glm::vec3& cameraPosition, unsigned long long frame);
+    void clear();
+
+    // Chunks evicted by the last trim(), so structures built from them can drop them too
+    const std::vector<ChunkCoord>& evicted() const { return evictedChunks; }
+
+    const ResidencyStats& stats() const { return residencyStats; }
+
+private:
+    // Drops a chunk and its mesh, taking it off the totals
+    void evict(const ChunkCoord& coord);
+    void evictLod(const LodCell& cell);
+
+    ChunkMap<Chunk> chunks;
+    ChunkMap<LodChunk> lods[MAX_LOD_LEVELS]; // Indexed by level - 1
+    std::vector<ChunkCoord> evictedChunks;
+    size_t cpuBudget = 0;
+    size_t gpuBudget = 0;
+    MeshPool* meshPool = nullptr;
+    ResidencyStats residencyStats;
+};
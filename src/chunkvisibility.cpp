@@ -0,0 +1,91 @@
+#include "chunkvisibility.h"
+
+namespace {
+
+const int HORIZONTAL_FACES[4] = { FACE_NEG_X, FACE_POS_X, FACE_NEG_Z, FACE_POS_Z };
+
+int oppositeFace(int face) { return face ^ 1; }
+
+FaceConnectivity connectivityOf(ChunkResidency& residency, const ChunkCoord& coord) {
+    const Chunk* chunk = residency.peek(coord);
+    return chunk && chunk->meshed ? chunk->connectivity : FACE_CONNECTIVITY_ALL;
+}
+
+} // namespace
+
+int ChunkVisibility::slot(const ChunkCoord& coord) const {
+    int x = coord.first - origin.first, z = coord.second - origin.second;
+    return x < 0 || z < 0 || x >= side || z >= side ? -1 : z * side + x;
+}
+
+void ChunkVisibility::enqueue(const ChunkCoord& coord, int entry, unsigned char directions) {
+    int index = slot(coord);
+    if (index < 0 || (entries[index] & (1 << entry))) {
+        return;
+    }
+    if (!entries[index]) {
+        ++reached;
+    }
+    entries[index] |= 1 << entry;
+    queue.push_back({ coord, entry, directions });
+}
+
+void ChunkVisibility::update(const ChunkCoord& centre, int radius, bool fromSky, ChunkResidency& residency) {
+    side = 2 * radius + 1;
+    origin = std::make_pair(centre.first - radius, centre.second - radius);
+    entries.assign(side * side, 0);
+    queue.clear();
+    reached = 0;
+
+    bool skyOpen = fromSky, skyAdded = false;
+    if (!fromSky) {
+        // The camera chunk can see out of every face whatever its connectivity
+        entries[slot(centre)] = 1 << FACE_POS_Y;
+        reached = 1;
+        queue.push_back({ centre, -1, 0 });
+    }
+
+    for (size_t next = 0;; ++next) {
+        if (next == queue.size()) {
+            if (!skyOpen || skyAdded) {
+                break;
+            }
+            // Looking down from the sky into every chunk with an open top
+            skyAdded = true;
+            for (int z = 0; z < side; ++z) {
+                for (int x = 0; x < side; ++x) {
+                    ChunkCoord coord = std::make_pair(origin.first + x, origin.second + z);
+                    if (facesConnected(connectivityOf(residency, coord), FACE_POS_Y, FACE_POS_Y)) {
+                        enqueue(coord, FACE_POS_Y, 0);
+                    }
+                }
+            }
+            if (next == queue.size()) {
+                break;
+            }
+        }
+
+        Step step = queue[next];
+        FaceConnectivity connectivity = connectivityOf(residency, step.coord);
+        if (step.entry < 0 || facesConnected(connectivity, step.entry, FACE_POS_Y)) {
+            skyOpen = true;
+        }
+        for (int face : HORIZONTAL_FACES) {
+            // Sight lines don't turn back towards the camera
+            if (step.directions & (1 << oppositeFace(face))) {
+                continue;
+            }
+            if (step.entry >= 0 && !facesConnected(connectivity, step.entry, face)) {
+                continue;
+            }
+            int dx = face == FACE_NEG_X ? -1 : (face == FACE_POS_X ? 1 : 0);
+            int dz = face == FACE_NEG_Z ? -1 : (face == FACE_POS_Z ? 1 : 0);
+            enqueue(std::make_pair(step.coord.first + dx, step.coord.second + dz), oppositeFace(face), step.directions | (1 << face));
+        }
+    }
+}
+
+bool ChunkVisibility::visible(const ChunkCoord& coord) const {
+    int index = slot(coord);
+    return index >= 0 && entries[index] != 0;
+}
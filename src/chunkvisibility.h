@@ -0,0 +1,37 @@
+#pragma once
+#include <vector>
+#include "chunkcoord.h"
+#include "chunkresidency.h"
+
+// Which chunks of the view window could be seen from the camera chunk, found
+// by a breadth-first search across chunk faces. A step from one chunk to the
+// next is only taken when the face it entered by connects to the face it
+// leaves by (Chunk::connectivity), and never back towards the camera, so
+// chunks sealed off behind rock are never reached. Everything above the chunks
+// is open sky: once the search gets out through a chunk's top, every chunk
+// with air on its top face is reachable from above. Chunks without a mesh yet
+// count as fully open.
+class ChunkVisibility {
+public:
+    // Searches the (2 * radius + 1)^2 window around centre. fromSky when the
+    // camera is above the chunks rather than inside one.
+    void update(const ChunkCoord& centre, int radius, bool fromSky, ChunkResidency& residency);
+    bool visible(const ChunkCoord& coord) const;
+    int reachedCount() const { return reached; }
+
+private:
+    struct Step {
+        ChunkCoord coord;
+        int entry;                // Face the search came in by, -1 for the camera chunk
+        unsigned char directions; // Bit per horizontal face already stepped through
+    };
+
+    int slot(const ChunkCoord& coord) const;
+    void enqueue(const ChunkCoord& coord, int entry, unsigned char directions);
+
+    ChunkCoord origin; // Chunk in slot 0
+    int side = 0;
+    int reached = 0;
+    std::vector<unsigned char> entries; // Per slot, a bit for every face the search has entered by
+    std::vector<Step> queue;            // Kept between frames to reuse the storage
+};
@@ -0,0 +1,101 @@
+#include "chunkvoxels.h"
+#include <algorithm>
+
+void ChunkVoxels::set(int x, int y, int z, BlockID block) {
+    if (bits == 0) {
+        if (block == uniform) {
+            return;
+        }
+        // First differing voxel: start a palette with the old value and a 1 bit index
+        palette.assign(1, uniform);
+        words.assign(VOLUME / 64, 0);
+        bits = 1;
+    }
+
+    auto found = std::find(palette.begin(), palette.end(), block);
+    uint64_t paletteIndex = found - palette.begin();
+    if (found == palette.end()) {
+        palette.push_back(block);
+        if (palette.size() > (1u << bits)) {
+            repack(bits == 8 ? 16 : bits * 2);
+        }
+    }
+
+    int bit = index(x, y, z) * bits;
+    uint64_t& word = words[bit >> 6];
+    word = (word & ~(mask() << (bit & 63))) | (paletteIndex << (bit & 63));
+}
+
+void ChunkVoxels::fill(BlockID block) {
+    uniform = block;
+    bits = 0;
+    std::vector<BlockID>().swap(palette);
+    std::vector<uint64_t>().swap(words);
+}
+
+void ChunkVoxels::repack(int newBits) {
+    std::vector<uint64_t> packed(VOLUME * newBits / 64, 0);
+    for (int i = 0; i < VOLUME; ++i) {
+        int oldBit = i * bits;
+        uint64_t value = (words[oldBit >> 6] >> (oldBit & 63)) & mask();
+        int newBit = i * newBits;
+        packed[newBit >> 6] |= value << (newBit & 63);
+    }
+    words.swap(packed);
+    bits = newBits;
+}
+
+void ChunkVoxels::compact() {
+    if (bits == 0) {
+        return;
+    }
+
+    std::vector<BlockID> blocks(VOLUME);
+    unpack(blocks.data());
+
+    // Rebuild the palette from what's actually used, keeping first-seen order
+    std::vector<BlockID> used;
+    for (BlockID block : blocks) {
+        if (std::find(used.begin(), used.end(), block) == used.end()) {
+            used.push_back(block);
+        }
+    }
+    if (used.size() == 1) {
+        fill(used[0]);
+        return;
+    }
+
+    int newBits = 1;
+    while ((1u << newBits) < used.size()) {
+        newBits = newBits == 8 ? 16 : newBits * 2;
+    }
+
+    std::vector<uint64_t> packed(VOLUME * newBits / 64, 0);
+    for (int i = 0; i < VOLUME; ++i) {
+        uint64_t value = std::find(used.begin(), used.end(), blocks[i]) - used.begin();
+        int bit = i * newBits;
+        packed[bit >> 6] |= value << (bit & 63);
+    }
+    palette.swap(used);
+    palette.shrink_to_fit();
+    words.swap(packed);
+    bits = newBits;
+}
+
+size_t ChunkVoxels::memoryBytes() const {
+    return sizeof(ChunkVoxels) + palette.capacity() * sizeof(BlockID) + words.capacity() * sizeof(uint64_t);
+}
+
+void ChunkVoxels::unpack(BlockID* out) const {
+    if (bits == 0) {
+        std::fill(out, out + VOLUME, uniform);
+        return;
+    }
+    const int perWord = 64 / bits;
+    for (size_t w = 0; w < words.size(); ++w) {
+        uint64_t word = words[w];
+        for (int j = 0; j < perWord; ++j, word >>= bits) {
+            *out++ = palette[word & mask()];
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "chunkcoord.h"
+
+typedef uint16_t BlockID;
+
+enum Block : BlockID {
+    BLOCK_AIR = 0,
+    BLOCK_STONE,
+    BLOCK_DIRT,
+    BLOCK_GRASS
+};
+
+// Voxel contents of one CHUNK_SIZE^3 chunk. Each chunk has its own palette of
+// the blocks it uses, and voxels store bit-packed palette indices: 1, 2, 4 or 8
+// bits per voxel (16 for pathological chunks), grown on demand. A chunk made of
+// a single block (all air, all stone) stores no voxel array at all.
+class ChunkVoxels {
+public:
+    static const int VOLUME = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+
+    explicit ChunkVoxels(BlockID block = BLOCK_AIR) : uniform(block) {}
+
+    static int index(int x, int y, int z) { return (y * CHUNK_SIZE + z) * CHUNK_SIZE + x; }
+
+    BlockID get(int x, int y, int z) const {
+        if (bits == 0) {
+            return uniform;
+        }
+        int bit = index(x, y, z) * bits;
+        return palette[(words[bit >> 6] >> (bit & 63)) & mask()];
+    }
+    void set(int x, int y, int z, BlockID block);
+
+    // Makes the whole chunk a single block and frees the voxel array
+    void fill(BlockID block);
+    // Drops palette entries no voxel uses any more and shrinks the index width,
+    // back to a single value if only one block is left
+    void compact();
+
+    bool isUniform() const { return bits == 0; }
+    bool isEmpty() const { return bits == 0 && uniform == BLOCK_AIR; }
+    int bitsPerVoxel() const { return bits; }
+    size_t memoryBytes() const;
+
+    // Decodes every voxel, in index() order, into out[VOLUME]
+    void unpack(BlockID* out) const;
+
+    // Calls f(x, y, z, block) for every voxel that isn't air, decoding a word at a time
+    template <typename F>
+    void forEachSolid(F f) const {
+        if (bits == 0) {
+            if (uniform != BLOCK_AIR) {
+                for (int i = 0; i < VOLUME; ++i) {
+                    f(i % CHUNK_SIZE, i / (CHUNK_SIZE * CHUNK_SIZE), (i / CHUNK_SIZE) % CHUNK_SIZE, uniform);
+                }
+            }
+            return;
+        }
+        const int perWord = 64 / bits;
+        for (size_t w = 0; w < words.size(); ++w) {
+            uint64_t word = words[w];
+            if (word == 0 && palette[0] == BLOCK_AIR) {
+                continue; // A whole word of air
+            }
+            for (int j = 0; j < perWord; ++j, word >>= bits) {
+                BlockID block = palette[word & mask()];
+                if (block != BLOCK_AIR) {
+                    int i = static_cast<int>(w) * perWord + j;
+                    f(i % CHUNK_SIZE, i / (CHUNK_SIZE * CHUNK_SIZE), (i / CHUNK_SIZE) % CHUNK_SIZE, block);
+                }
+            }
+        }
+    }
+
+private:
+    uint64_t mask() const { return (1ull << bits) - 1; }
+    void repack(int newBits);
+
+    BlockID uniform;              // The block of a single-value chunk
+    int bits = 0;                 // 0 for single-value chunks
+    std::vector<BlockID> palette; // Palette index -> block
+    std::vector<uint64_t> words;  // VOLUME indices of `bits` bits; never straddle a word
+};
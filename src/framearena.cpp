@@ -0,0 +1,97 @@
+#include "framearena.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace {
+
+const size_t MIN_BLOCK_SIZE = 64 * 1024;
+
+thread_local unsigned long long heapAllocations = 0;
+
+} // namespace
+
+// Counts every allocation through the default operator new. The array and
+// nothrow forms forward here, so this sees all container and new-expression
+// traffic; direct malloc calls from C libraries and the driver are not counted.
+void* operator new(std::size_t size) {
+    ++heapAllocations;
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+unsigned long long heapAllocationCount() {
+    return heapAllocations;
+}
+
+FrameArena& frameArena() {
+    thread_local FrameArena arena;
+    return arena;
+}
+
+void FrameArena::reserve(size_t bytes) {
+    if (bytes > block.size()) {
+        block.resize(bytes);
+    }
+    reset();
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment) {
+    uintptr_t base = reinterpret_cast<uintptr_t>(current);
+    size_t start = ((base + head + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+    if (!current || start + size > currentSize) {
+        // Spill into a new block; reset() folds it into the main block afterwards
+        overflow.emplace_back(std::max(std::max(size + alignment, block.size()), MIN_BLOCK_SIZE));
+        current = overflow.back().data();
+        currentSize = overflow.back().size();
+        head = 0;
+        base = reinterpret_cast<uintptr_t>(current);
+        start = ((base + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+    }
+    usedBytes += start - head + size;
+    head = start + size;
+    return current + start;
+}
+
+void FrameArena::reset() {
+    highWaterBytes = std::max(highWaterBytes, usedBytes);
+    poison(block.data(), block.size());
+
+    if (!overflow.empty()) {
+        // Grow so a frame like this one fits in the main block next time
+        size_t grown = (highWaterBytes + MIN_BLOCK_SIZE - 1) / MIN_BLOCK_SIZE * MIN_BLOCK_SIZE;
+        overflow.clear();
+        if (grown > block.size()) {
+            block.assign(grown, 0);
+            ++growCount;
+        }
+    }
+
+    current = block.empty() ? nullptr : block.data();
+    currentSize = block.size();
+    head = 0;
+    usedBytes = 0;
+}
+
+void FrameArena::poison(void* ptr, size_t size) {
+#ifdef FRAME_ARENA_DEBUG
+    if (ptr) {
+        std::memset(ptr, 0xDD, size);
+    }
+#else
+    (void)ptr;
+    (void)size;
+#endif
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Bump allocator for data that only lives for one frame: visible chunk lists,
+// mesh staging, sort scratch. Each thread has its own arena (frameArena()),
+// reset at the start of every frame on the render thread and after every job
+// on the workers. Individual frees are no-ops; reset() drops everything at once.
+// If a frame outgrows the arena it spills into extra blocks, and the next
+// reset() grows the arena to the high-water mark so later frames fit again.
+// Build with -DFRAME_ARENA_DEBUG to overwrite freed memory with 0xDD, so
+// anything read after its frame ends shows up as garbage.
+class FrameArena {
+public:
+    void reserve(size_t bytes);
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+    void reset();
+
+    size_t used() const { return usedBytes; }
+    size_t capacity() const { return block.size(); }
+    size_t highWater() const { return highWaterBytes; }
+    unsigned int grows() const { return growCount; } // Times reset() grew the main block
+
+    // Overwrites memory that is no longer in use; does nothing without FRAME_ARENA_DEBUG
+    static void poison(void* ptr, size_t size);
+
+private:
+    std::vector<unsigned char> block;                 // Main block, reused every frame
+    std::vector<std::vector<unsigned char>> overflow; // Spill blocks for the current frame only
+    unsigned char* current = nullptr;
+    size_t currentSize = 0;
+    size_t head = 0;
+    size_t usedBytes = 0;
+    size_t highWaterBytes = 0;
+    unsigned int growCount = 0;
+};
+
+// The calling thread's arena
+FrameArena& frameArena();
+
+// Number of operator new calls made on the calling thread so far; the
+// difference across a frame shows whether it touched the general heap
+unsigned long long heapAllocationCount();
+
+// Lets standard containers live in the calling thread's arena for the frame
+template <typename T>
+struct FrameAllocator {
+    typedef T value_type;
+
+    FrameAllocator() = default;
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U>&) {}
+
+    T* allocate(size_t count) { return static_cast<T*>(frameArena().allocate(count * sizeof(T), alignof(T))); }
+    void deallocate(T* ptr, size_t count) { FrameArena::poison(ptr, count * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const FrameAllocator<U>&) const { return true; }
+    template <typename U>
+    bool operator!=(const FrameAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
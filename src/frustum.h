@@ -0,0 +1,35 @@
+#pragma once
+#include <glm/glm.hpp>
+
+// View frustum as six planes pulled out of a view-projection matrix
+// (Gribb-Hartmann), for rejecting boxes before anything else looks at them
+struct Frustum {
+    glm::vec4 planes[6]; // xyz points inwards; a point p is inside when dot(xyz, p) + w >= 0
+
+    void update(const glm::mat4& viewProjection) {
+        // glm is column-major, so row r of the matrix is (m[0][r], m[1][r], m[2][r], m[3][r])
+        const glm::mat4& m = viewProjection;
+        for (int axis = 0; axis < 3; ++axis) {
+            for (int side = 0; side < 2; ++side) {
+                float sign = side == 0 ? 1.0f : -1.0f;
+                glm::vec4& plane = planes[axis * 2 + side];
+                for (int column = 0; column < 4; ++column) {
+                    plane[column] = m[column][3] + sign * m[column][axis];
+                }
+            }
+        }
+    }
+
+    // False only when the box is entirely outside one of the planes
+    bool intersects(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const {
+        for (const glm::vec4& plane : planes) {
+            // The corner furthest along the plane normal
+            glm::vec3 corner(plane.x >= 0.0f ? boundsMax.x : boundsMin.x, plane.y >= 0.0f ? boundsMax.y : boundsMin.y,
+                             plane.z >= 0.0f ? boundsMax.z : boundsMin.z);
+            if (plane.x * corner.x + plane.y * corner.y + plane.z * corner.z + plane.w < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
@@ -0,0 +1,190 @@
+#include "glstate.h"
+#include <iostream>
+
+namespace {
+
+GLuint queryState(GLenum query) {
+    GLint values[4] = {}; // GL_POLYGON_MODE gives front and back in compatibility profiles
+    glGetIntegerv(query, values);
+    return static_cast<GLuint>(values[0]);
+}
+
+} // namespace
+
+void GLStateCache::invalidate() {
+    program = vertexArray = arrayBuffer = elementBuffer = indirectBuffer = polygon = GL_STATE_UNKNOWN;
+    depthTest = cullFaceEnabled = blend = GL_STATE_UNKNOWN;
+    depthFunction = depthWrite = cullFaceMode = frontFaceMode = blendSource = blendDestination = GL_STATE_UNKNOWN;
+}
+
+bool GLStateCache::redundant(GLuint& current, GLuint wanted, GLenum query, const char* name) {
+    if (current != wanted) {
+        current = wanted;
+        ++cacheStats.issued;
+        return false;
+    }
+    if (validation) {
+        GLuint actual = queryState(query);
+        if (actual != wanted) {
+            std::cerr << "GL state cache: " << name << " is " << actual << " but was cached as " << wanted << std::endl;
+            ++cacheStats.mismatches;
+            ++cacheStats.issued;
+            return false;
+        }
+    }
+    ++cacheStats.filtered;
+    return true;
+}
+
+void GLStateCache::useProgram(GLuint wanted) {
+    if (!redundant(program, wanted, GL_CURRENT_PROGRAM, "program")) {
+        glUseProgram(wanted);
+    }
+}
+
+void GLStateCache::bindVertexArray(GLuint wanted) {
+    if (!redundant(vertexArray, wanted, GL_VERTEX_ARRAY_BINDING, "vertex array")) {
+        glBindVertexArray(wanted);
+        elementBuffer = GL_STATE_UNKNOWN;
+    }
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer) {
+    bool skip = false;
+    switch (target) {
+    case GL_ARRAY_BUFFER:
+        skip = redundant(arrayBuffer, buffer, GL_ARRAY_BUFFER_BINDING, "array buffer");
+        break;
+    case GL_ELEMENT_ARRAY_BUFFER:
+        skip = redundant(elementBuffer, buffer, GL_ELEMENT_ARRAY_BUFFER_BINDING, "element buffer");
+        break;
+    case GL_DRAW_INDIRECT_BUFFER:
+        skip = redundant(indirectBuffer, buffer, GL_DRAW_INDIRECT_BUFFER_BINDING, "indirect buffer");
+        break;
+    default:
+        ++cacheStats.issued;
+        break;
+    }
+    if (!skip) {
+        glBindBuffer(target, buffer);
+    }
+}
+
+void GLStateCache::polygonMode(GLenum mode) {
+    if (!redundant(polygon, mode, GL_POLYGON_MODE, "polygon mode")) {
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+    }
+}
+
+GLuint* GLStateCache::capabilityState(GLenum capability) {
+    switch (capability) {
+    case GL_DEPTH_TEST: return &depthTest;
+    case GL_CULL_FACE: return &cullFaceEnabled;
+    case GL_BLEND: return &blend;
+    default: return nullptr;
+    }
+}
+
+void GLStateCache::setCapability(GLenum capability, bool enabled) {
+    GLuint* state = capabilityState(capability);
+    if (state && redundant(*state, enabled ? GL_TRUE : GL_FALSE, capability, "capability")) {
+        return;
+    }
+    if (!state) {
+        ++cacheStats.issued;
+    }
+    if (enabled) {
+        glEnable(capability);
+    } else {
+        glDisable(capability);
+    }
+}
+
+void GLStateCache::enable(GLenum capability) {
+    setCapability(capability, true);
+}
+
+void GLStateCache::disable(GLenum capability) {
+    setCapability(capability, false);
+}
+
+void GLStateCache::depthFunc(GLenum func) {
+    if (!redundant(depthFunction, func, GL_DEPTH_FUNC, "depth func")) {
+        glDepthFunc(func);
+    }
+}
+
+void GLStateCache::depthMask(GLboolean mask) {
+    if (!redundant(depthWrite, mask ? GL_TRUE : GL_FALSE, GL_DEPTH_WRITEMASK, "depth mask")) {
+        glDepthMask(mask);
+    }
+}
+
+void GLStateCache::cullFace(GLenum face) {
+    if (!redundant(cullFaceMode, face, GL_CULL_FACE_MODE, "cull face")) {
+        glCullFace(face);
+    }
+}
+
+void GLStateCache::frontFace(GLenum mode) {
+    if (!redundant(frontFaceMode, mode, GL_FRONT_FACE, "front face")) {
+        glFrontFace(mode);
+    }
+}
+
+void GLStateCache::blendFunc(GLenum source, GLenum destination) {
+    // One call sets both factors, so it is only dropped when both already match
+    bool same = blendSource == source && blendDestination == destination;
+    if (same && validation && (queryState(GL_BLEND_SRC_RGB) != source || queryState(GL_BLEND_DST_RGB) != destination)) {
+        std::cerr << "GL state cache: blend func differs from the cached " << source << ", " << destination << std::endl;
+        ++cacheStats.mismatches;
+        same = false;
+    }
+    if (same) {
+        ++cacheStats.filtered;
+        return;
+    }
+    blendSource = source;
+    blendDestination = destination;
+    ++cacheStats.issued;
+    glBlendFunc(source, destination);
+}
+
+int GLStateCache::validate() {
+    struct Check {
+        GLuint* value;
+        GLenum query;
+        const char* name;
+    };
+    Check checks[] = {
+        { &program, GL_CURRENT_PROGRAM, "program" },
+        { &vertexArray, GL_VERTEX_ARRAY_BINDING, "vertex array" },
+        { &arrayBuffer, GL_ARRAY_BUFFER_BINDING, "array buffer" },
+        { &elementBuffer, GL_ELEMENT_ARRAY_BUFFER_BINDING, "element buffer" },
+        { &indirectBuffer, GL_DRAW_INDIRECT_BUFFER_BINDING, "indirect buffer" },
+        { &polygon, GL_POLYGON_MODE, "polygon mode" },
+        { &depthTest, GL_DEPTH_TEST, "depth test" },
+        { &cullFaceEnabled, GL_CULL_FACE, "face culling" },
+        { &blend, GL_BLEND, "blending" },
+        { &depthFunction, GL_DEPTH_FUNC, "depth func" },
+        { &depthWrite, GL_DEPTH_WRITEMASK, "depth mask" },
+        { &cullFaceMode, GL_CULL_FACE_MODE, "cull face" },
+        { &frontFaceMode, GL_FRONT_FACE, "front face" },
+        { &blendSource, GL_BLEND_SRC_RGB, "blend source" },
+        { &blendDestination, GL_BLEND_DST_RGB, "blend destination" },
+    };
+    int differences = 0;
+    for (const Check& check : checks) {
+        if (*check.value == GL_STATE_UNKNOWN) {
+            continue;
+        }
+        GLuint actual = queryState(check.query);
+        if (actual != *check.value) {
+            std::cerr << "GL state cache: " << check.name << " is " << actual << " but was cached as " << *check.value << std::endl;
+            *check.value = actual;
+            ++differences;
+        }
+    }
+    cacheStats.mismatches += differences;
+    return differences;
+}
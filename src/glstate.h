@@ -0,0 +1,62 @@
+#pragma once
+#include <GL/glew.h>
+
+#define GL_STATE_UNKNOWN 0xFFFFFFFFu // Value not known, so the next call setting it always reaches GL
+
+struct GLStateStats {
+    unsigned long long issued = 0;     // Calls passed on to GL
+    unsigned long long filtered = 0;   // Calls dropped because GL already had that state
+    unsigned long long mismatches = 0; // Cached values validation found GL disagreeing with
+};
+
+// Remembers the GL state the renderer sets and drops calls that wouldn't change
+// it. Covers the program, VAO, array, element and indirect buffer bindings,
+// polygon mode and the depth, cull and blend state. Anything set behind the
+// cache's back must be followed by invalidate(). Buffers bound through the
+// cache should be unbound before they are deleted, as GL may hand the name out
+// again. In validation mode every dropped call is checked with glGet* first,
+// and mismatches are logged and issued anyway.
+class GLStateCache {
+public:
+    void invalidate();
+    void setValidation(bool enabled) { validation = enabled; }
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vertexArray);
+    // Other targets go straight to GL
+    void bindBuffer(GLenum target, GLuint buffer);
+    // Always GL_FRONT_AND_BACK, the only face core profiles accept
+    void polygonMode(GLenum mode);
+    // GL_DEPTH_TEST, GL_CULL_FACE and GL_BLEND are cached; other capabilities go straight to GL
+    void enable(GLenum capability);
+    void disable(GLenum capability);
+    void depthFunc(GLenum func);
+    void depthMask(GLboolean mask);
+    void cullFace(GLenum face);
+    void frontFace(GLenum mode);
+    void blendFunc(GLenum source, GLenum destination);
+
+    // Compares every known value with glGet*, logging differences and taking GL's
+    // value; returns how many differed
+    int validate();
+    const GLStateStats& stats() const { return cacheStats; }
+
+private:
+    // Whether a call setting current to wanted can be dropped; records wanted otherwise
+    bool redundant(GLuint& current, GLuint wanted, GLenum query, const char* name);
+    void setCapability(GLenum capability, bool enabled);
+    GLuint* capabilityState(GLenum capability);
+
+    bool validation = false;
+    GLuint program = GL_STATE_UNKNOWN;
+    GLuint vertexArray = GL_STATE_UNKNOWN;
+    GLuint arrayBuffer = GL_STATE_UNKNOWN;
+    GLuint elementBuffer = GL_STATE_UNKNOWN; // Part of the VAO, so forgotten when it changes
+    GLuint indirectBuffer = GL_STATE_UNKNOWN;
+    GLuint polygon = GL_STATE_UNKNOWN;
+    GLuint depthTest = GL_STATE_UNKNOWN, cullFaceEnabled = GL_STATE_UNKNOWN, blend = GL_STATE_UNKNOWN;
+    GLuint depthFunction = GL_STATE_UNKNOWN, depthWrite = GL_STATE_UNKNOWN;
+    GLuint cullFaceMode = GL_STATE_UNKNOWN, frontFaceMode = GL_STATE_UNKNOWN;
+    GLuint blendSource = GL_STATE_UNKNOWN, blendDestination = GL_STATE_UNKNOWN;
+    GLStateStats cacheStats;
+};
@@ -0,0 +1,247 @@
+#include "horizonculler.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "terrainbvh.h"
+
+namespace {
+
+const float BUCKETS_PER_UNIT = HORIZON_BUCKETS / 4.0f; // Pseudo-angles run over [0, 4)
+
+double nowMs() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Monotonic in the true angle of (x, z), in [0, 4), without atan2
+float pseudoAngle(float x, float z) {
+    if (z >= 0.0f) {
+        return x >= 0.0f ? z / (x + z) : 1.0f - x / (z - x);
+    }
+    return x < 0.0f ? 2.0f - z / (-x - z) : 3.0f + x / (x - z);
+}
+
+// Horizontal distances from the eye to the nearest and farthest points of a rectangle
+template <typename Rect>
+void distances(const Rect& rect, const glm::vec3& eye, float& nearest, float& farthest) {
+    float dx = std::max({ rect.minX - eye.x, 0.0f, eye.x - rect.maxX });
+    float dz = std::max({ rect.minZ - eye.z, 0.0f, eye.z - rect.maxZ });
+    nearest = std::sqrt(dx * dx + dz * dz);
+    float fx = std::max(eye.x - rect.minX, rect.maxX - eye.x), fz = std::max(eye.z - rect.minZ, rect.maxZ - eye.z);
+    farthest = std::sqrt(fx * fx + fz * fz);
+}
+
+// Pseudo-angles the rectangle spans from the eye; low may be negative and high
+// past 4. The eye must not be over the rectangle, so two of its corners always
+// make the silhouette and the span is under half a turn.
+template <typename Rect>
+void span(const Rect& rect, const glm::vec3& eye, float& low, float& high) {
+    bool left = eye.x < rect.minX, right = eye.x > rect.maxX, below = eye.z < rect.minZ, above = eye.z > rect.maxZ;
+    float ax, az, bx, bz;
+    // Off a corner the silhouette is the other diagonal; off a side, that side's ends
+    if (left == below && right == above && (left || right)) {
+        ax = rect.maxX, az = rect.minZ, bx = rect.minX, bz = rect.maxZ;
+    } else if ((left && above) || (right && below)) {
+        ax = rect.minX, az = rect.minZ, bx = rect.maxX, bz = rect.maxZ;
+    } else if (below || above) {
+        ax = rect.minX, bx = rect.maxX, az = bz = below ? rect.minZ : rect.maxZ;
+    } else {
+        az = rect.minZ, bz = rect.maxZ, ax = bx = left ? rect.minX : rect.maxX;
+    }
+    float first = pseudoAngle(ax - eye.x, az - eye.z);
+    float delta = pseudoAngle(bx - eye.x, bz - eye.z) - first;
+    delta += delta > 2.0f ? -4.0f : (delta < -2.0f ? 4.0f : 0.0f);
+    low = first + std::min(delta, 0.0f);
+    high = first + std::max(delta, 0.0f);
+}
+
+int wrapBucket(int bucket) {
+    return bucket & (HORIZON_BUCKETS - 1);
+}
+
+static_assert((HORIZON_BUCKETS & (HORIZON_BUCKETS - 1)) == 0, "bucket indices wrap with a mask");
+
+} // namespace
+
+void HorizonCuller::build(const std::vector<float>& vertices, int width, int height) {
+    tiles.clear();
+    blocks.clear();
+    auto heightAt = [&](int x, int z) { return vertices[(static_cast<size_t>(z) * width + x) * 3 + 1]; };
+    auto range = [&](int x0, int z0, int x1, int z1, float& low, float& high) {
+        low = 3.0e38f;
+        high = -3.0e38f;
+        for (int z = z0; z <= z1; ++z) {
+            for (int x = x0; x <= x1; ++x) {
+                low = std::min(low, heightAt(x, z));
+                high = std::max(high, heightAt(x, z));
+            }
+        }
+    };
+
+    for (int tileZ = 0; tileZ < height - 1; tileZ += TERRAIN_TILE_CELLS) {
+        for (int tileX = 0; tileX < width - 1; tileX += TERRAIN_TILE_CELLS) {
+            int endX = std::min(tileX + TERRAIN_TILE_CELLS, width - 1), endZ = std::min(tileZ + TERRAIN_TILE_CELLS, height - 1);
+            Tile tile;
+            tile.rect = { float(tileX), float(tileZ), float(endX), float(endZ) };
+            range(tileX, tileZ, endX, endZ, tile.minY, tile.maxY);
+            tile.firstBlock = static_cast<int>(blocks.size());
+            for (int z = tileZ; z < endZ; z += HORIZON_BLOCK_CELLS) {
+                for (int x = tileX; x < endX; x += HORIZON_BLOCK_CELLS) {
+                    int x1 = std::min(x + HORIZON_BLOCK_CELLS, endX), z1 = std::min(z + HORIZON_BLOCK_CELLS, endZ);
+                    Block block;
+                    block.rect = { float(x), float(z), float(x1), float(z1) };
+                    float unused;
+                    range(x, z, x1, z1, block.minY, unused);
+                    blocks.push_back(block);
+                }
+            }
+            tile.blockCount = static_cast<int>(blocks.size()) - tile.firstBlock;
+            tiles.push_back(tile);
+        }
+    }
+    // Enough rings to reach across the map from any eye on it
+    rings.resize(static_cast<size_t>(std::sqrt(float(width) * width + float(height) * height) / HORIZON_RING) + 2);
+}
+
+bool HorizonCuller::anyNeeded(int first, int last) const {
+    if (last - first + 1 >= HORIZON_BUCKETS) {
+        return neededPrefix[HORIZON_BUCKETS] > 0;
+    }
+    int length = last - first + 1;
+    first = wrapBucket(first);
+    last = first + length - 1;
+    if (last < HORIZON_BUCKETS) {
+        return neededPrefix[last + 1] > neededPrefix[first];
+    }
+    return neededPrefix[HORIZON_BUCKETS] > neededPrefix[first] || neededPrefix[last - HORIZON_BUCKETS + 1] > 0;
+}
+
+int HorizonCuller::cull(const glm::vec3& eye, unsigned char* visible) {
+    double start = nowMs();
+    std::fill(horizon, horizon + HORIZON_BUCKETS, -3.0e38f);
+    for (std::vector<Occluder>& ring : rings) {
+        ring.clear();
+    }
+    int appliedRings = 0;
+    lastStats = HorizonStats();
+
+    // Where every tile is seen from, and which buckets the tiles to test fall in.
+    // Terrain in no such bucket can't hide anything we care about.
+    views.resize(tiles.size());
+    int needed[HORIZON_BUCKETS + 1] = {};
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        TileView& view = views[i];
+        distances(tiles[i].rect, eye, view.nearest, view.farthest);
+        if (view.nearest <= 0.0f) {
+            continue; // The eye is over it
+        }
+        span(tiles[i].rect, eye, view.low, view.high);
+        view.first = static_cast<int>(std::floor(view.low * BUCKETS_PER_UNIT));
+        view.last = static_cast<int>(std::floor(view.high * BUCKETS_PER_UNIT));
+        if (visible[i]) {
+            // Mark with a difference array, split where the span wraps around
+            int first = wrapBucket(view.first), last = first + view.last - view.first;
+            ++needed[first];
+            --needed[std::min(last + 1, HORIZON_BUCKETS)];
+            if (last >= HORIZON_BUCKETS) {
+                ++needed[0];
+                --needed[last - HORIZON_BUCKETS + 1];
+            }
+        }
+    }
+    int running = 0;
+    neededPrefix[0] = 0;
+    for (int b = 0; b < HORIZON_BUCKETS; ++b) {
+        running += needed[b];
+        neededPrefix[b + 1] = neededPrefix[b] + (running > 0);
+    }
+
+    // Front to back, bucketed by the ring holding each tile's nearest point;
+    // order within a ring doesn't matter since a ring only counts once passed
+    ringStarts.assign(rings.size() + 1, 0);
+    order.resize(tiles.size());
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        order[i] = std::min(static_cast<int>(views[i].nearest / HORIZON_RING), static_cast<int>(rings.size()) - 1);
+        ++ringStarts[order[i] + 1];
+    }
+    for (size_t ring = 1; ring < ringStarts.size(); ++ring) {
+        ringStarts[ring] += ringStarts[ring - 1];
+    }
+    sorted.resize(tiles.size());
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        sorted[ringStarts[order[i]]++] = static_cast<int>(i);
+    }
+
+    for (int index : sorted) {
+        const Tile& tile = tiles[index];
+        const TileView& view = views[index];
+        bool hidden = false;
+        float lowestHorizon = -3.0e38f; // Over the tile's buckets
+        if (view.nearest > 0.0f) {
+            if (!visible[index] && !anyNeeded(view.first, view.last)) {
+                continue; // Neither tested nor in the way of anything tested
+            }
+
+            // Every ring wholly nearer than this tile now counts
+            int reachedRing = std::min(static_cast<int>(view.nearest / HORIZON_RING), static_cast<int>(rings.size()));
+            for (; appliedRings < reachedRing; ++appliedRings) {
+                for (const Occluder& occluder : rings[appliedRings]) {
+                    for (int b = occluder.first;; b = wrapBucket(b + 1)) {
+                        horizon[b] = std::max(horizon[b], occluder.slope);
+                        if (b == occluder.last) {
+                            break;
+                        }
+                    }
+                }
+            }
+
+            // The steepest any point of the tile can appear
+            float rise = tile.maxY - eye.y;
+            float slope = rise / (rise >= 0.0f ? view.nearest : view.farthest);
+            lowestHorizon = 3.0e38f;
+            for (int b = view.first; b <= view.last; ++b) {
+                lowestHorizon = std::min(lowestHorizon, horizon[wrapBucket(b)]);
+            }
+            hidden = lowestHorizon > slope;
+        }
+
+        if (visible[index]) {
+            ++lastStats.tested;
+            if (hidden) {
+                visible[index] = 0;
+                ++lastStats.culled;
+            }
+        }
+        if (hidden) {
+            continue; // Nothing in it rises above the horizon already there
+        }
+
+        for (int i = tile.firstBlock; i < tile.firstBlock + tile.blockCount; ++i) {
+            const Block& block = blocks[i];
+            float nearest, farthest;
+            distances(block.rect, eye, nearest, farthest);
+            if (nearest <= 0.0f) {
+                continue;
+            }
+            // Every sight line over the block passes terrain at least this steep.
+            // The horizon only rises, so a block under it now never matters.
+            float rise = block.minY - eye.y;
+            float slope = rise / (rise >= 0.0f ? farthest : nearest);
+            size_t ring = static_cast<size_t>(farthest / HORIZON_RING);
+            if (slope <= lowestHorizon || ring >= rings.size()) {
+                continue;
+            }
+            // Only buckets the block covers completely
+            float low, high;
+            span(block.rect, eye, low, high);
+            int first = static_cast<int>(std::ceil(low * BUCKETS_PER_UNIT));
+            int last = static_cast<int>(std::floor(high * BUCKETS_PER_UNIT)) - 1;
+            if (last >= first && anyNeeded(first, last)) {
+                rings[ring].push_back({ slope, wrapBucket(first), wrapBucket(last) });
+            }
+        }
+    }
+
+    lastStats.cullMs = nowMs() - start;
+    return lastStats.culled;
+}
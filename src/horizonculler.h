@@ -0,0 +1,76 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+
+#define HORIZON_BUCKETS 1024   // Azimuth resolution of the horizon
+#define HORIZON_BLOCK_CELLS 8  // Heightmap cells along each edge of an occluder block
+#define HORIZON_RING 8.0f      // Width of the distance rings occluders wait in
+
+struct HorizonStats {
+    int tested = 0; // Tiles tested in the last cull
+    int culled = 0;
+    double cullMs = 0.0;
+};
+
+// Occlusion culling made for the heightmap terrain, which can't hide anything
+// under an overhang. Tiles are swept front to back from the eye while a
+// horizon is kept per azimuth bucket: the steepest slope (rise over distance)
+// that nearer terrain is known to reach in every direction of the bucket. A
+// tile whose highest point stays under the horizon across all its buckets is
+// hidden. Each tile is cut into blocks of HORIZON_BLOCK_CELLS cells; a block
+// raises the horizon by its lowest height seen from its far side, and only
+// once the sweep is past the distance ring holding that far side, so the
+// horizon never claims more than the terrain really blocks. Azimuths use a
+// pseudo-angle, no trigonometry.
+class HorizonCuller {
+public:
+    // Takes the vertex grid from generateTerrainVertices, tiled like the
+    // renderer's terrain tiles: TERRAIN_TILE_CELLS cells per tile, row by row
+    void build(const std::vector<float>& vertices, int width, int height);
+    // Clears visible[i] for tiles hidden behind nearer terrain. Only tiles
+    // with visible[i] set are tested; any tile in their directions can occlude
+    // them. Returns the number culled.
+    int cull(const glm::vec3& eye, unsigned char* visible);
+
+    size_t tileCount() const { return tiles.size(); }
+    const HorizonStats& stats() const { return lastStats; }
+
+private:
+    struct Rect {
+        float minX, minZ, maxX, maxZ;
+    };
+    struct Block {
+        Rect rect;
+        float minY;
+    };
+    struct Tile {
+        Rect rect;
+        float minY, maxY;
+        int firstBlock, blockCount;
+    };
+    // A horizon raise waiting until the sweep has passed its ring
+    struct Occluder {
+        float slope;
+        int first, last; // Buckets, inclusive; last < first wraps around
+    };
+
+    // How a tile looks from the eye this frame
+    struct TileView {
+        float nearest = 0.0f, farthest = 0.0f; // Horizontal distances
+        float low = 0.0f, high = 0.0f;         // Pseudo-angle span
+        int first = 0, last = 0;               // Buckets it touches, unwrapped
+    };
+
+    // Whether any bucket in [first, last] holds a tile being tested; indices may be unwrapped
+    bool anyNeeded(int first, int last) const;
+
+    std::vector<Tile> tiles;
+    std::vector<Block> blocks;
+    float horizon[HORIZON_BUCKETS];
+    int neededPrefix[HORIZON_BUCKETS + 1]; // Running count of buckets some tested tile falls in
+    // Kept between frames to reuse the storage
+    std::vector<std::vector<Occluder>> rings; // Occluders by farthest distance, HORIZON_RING wide
+    std::vector<TileView> views;
+    std::vector<int> order, ringStarts, sorted;
+    HorizonStats lastStats;
+};
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <sstream>
 #include "renderer.h"
+#include "framearena.h"
 #include "camera.h"
 
 // Camera instance
@@ -129,7 +130,12 @@ int main(int argc, char** argv) {
     camera.Position = glm::vec3(0.0f, 10.0f, 20.0f); // Adjust as needed
 
     // Main rendering loop
+    double titleTime = glfwGetTime();
+    int titleFrames = 0;
     while (!glfwWindowShouldClose(window)) {
+        // Transient allocations from the last frame are no longer referenced
+        frameArena().reset();
+
         // Calculate deltaTime
         float currentFrame = glfwGetTime();
         float deltaTime = currentFrame - lastFrame;
@@ -138,9 +144,23 @@ int main(int argc, char** argv) {
         // Process input for camera movement
         camera.ProcessKeyboard(window, deltaTime);
 
+        // Track the chunks around the camera
+        renderer.updateVisitedChunks(renderer.getCurrentChunk(camera.Position.x, camera.Position.z));
+
         // Rendering scene
         renderer.render();
 
+        // Frame rate and how much the occlusion culler hid, once a second
+        ++titleFrames;
+        if (currentFrame - titleTime >= 1.0) {
+            std::stringstream title;
+            title << "3D Render - " << static_cast<int>(titleFrames / (currentFrame - titleTime)) << " fps, "
+                  << static_cast<int>(renderer.occlusionStats().rate() * 100.0f) << "% occluded";
+            glfwSetWindowTitle(window, title.str().c_str());
+            titleTime = currentFrame;
+            titleFrames = 0;
+        }
+
         // Check for OpenGL errors
         checkGLError("After rendering");
 
@@ -0,0 +1,332 @@
+#include "meshpool.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace {
+
+double nowMs() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+int highestBit(uint32_t bits) { return 31 - __builtin_clz(bits); }
+int lowestBit(uint32_t bits) { return __builtin_ctz(bits); }
+
+} // namespace
+
+bool MeshPool::create(GLsizeiptr vertices) {
+    capacity = static_cast<GLsizei>(vertices);
+    glGenBuffers(1, &bufferID);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+    glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(capacity) * sizeof(ChunkVertex), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    blocks.clear();
+    unusedBlocks.clear();
+    handles.clear();
+    unusedHandles.clear();
+    firstLevel = 0;
+    for (int fl = 0; fl < FL_COUNT; ++fl) {
+        secondLevel[fl] = 0;
+        for (int sl = 0; sl < SL_COUNT; ++sl) {
+            freeHeads[fl][sl] = NONE;
+        }
+    }
+    poolStats = MeshPoolStats();
+    poolStats.capacityBytes = static_cast<size_t>(capacity) * sizeof(ChunkVertex);
+
+    // The whole buffer starts as one free range
+    lastBlock = newBlock();
+    blocks[lastBlock].size = capacity;
+    release(lastBlock);
+    updateLargestFree();
+    return true;
+}
+
+void MeshPool::destroy() {
+    glDeleteBuffers(1, &bufferID);
+    bufferID = 0;
+    capacity = 0;
+    blocks.clear();
+    handles.clear();
+}
+
+void MeshPool::mapping(GLsizei size, int& fl, int& sl) {
+    // Sizes below SL_COUNT each get a class of their own, above that each power of two is split in SL_COUNT
+    if (size < SL_COUNT) {
+        fl = 0;
+        sl = size;
+        return;
+    }
+    int log2 = highestBit(static_cast<uint32_t>(size));
+    fl = log2 - SL_LOG2 + 1;
+    sl = (size >> (log2 - SL_LOG2)) - SL_COUNT;
+}
+
+int MeshPool::newBlock() {
+    if (!unusedBlocks.empty()) {
+        int block = unusedBlocks.back();
+        unusedBlocks.pop_back();
+        blocks[block] = Block();
+        return block;
+    }
+    blocks.push_back(Block());
+    return static_cast<int>(blocks.size()) - 1;
+}
+
+void MeshPool::insertFree(int block) {
+    int fl, sl;
+    mapping(blocks[block].size, fl, sl);
+    blocks[block].prevFree = NONE;
+    blocks[block].nextFree = freeHeads[fl][sl];
+    if (freeHeads[fl][sl] != NONE) {
+        blocks[freeHeads[fl][sl]].prevFree = block;
+    }
+    freeHeads[fl][sl] = block;
+    firstLevel |= 1u << fl;
+    secondLevel[fl] |= 1u << sl;
+}
+
+void MeshPool::removeFree(int block) {
+    int fl, sl;
+    mapping(blocks[block].size, fl, sl);
+    Block& b = blocks[block];
+    if (b.prevFree != NONE) {
+        blocks[b.prevFree].nextFree = b.nextFree;
+    } else {
+        freeHeads[fl][sl] = b.nextFree;
+    }
+    if (b.nextFree != NONE) {
+        blocks[b.nextFree].prevFree = b.prevFree;
+    }
+    if (freeHeads[fl][sl] == NONE) {
+        secondLevel[fl] &= ~(1u << sl);
+        if (secondLevel[fl] == 0) {
+            firstLevel &= ~(1u << fl);
+        }
+    }
+}
+
+int MeshPool::findFree(GLsizei size) const {
+    // Round up to the next class boundary so any block in the class found is big enough
+    if (size >= SL_COUNT) {
+        size += (1 << (highestBit(static_cast<uint32_t>(size)) - SL_LOG2)) - 1;
+    }
+    int fl, sl;
+    mapping(size, fl, sl);
+    if (fl >= FL_COUNT) {
+        return NONE;
+    }
+    uint32_t slMap = secondLevel[fl] & (~0u << sl);
+    if (!slMap) {
+        uint32_t flMap = fl + 1 < FL_COUNT ? firstLevel & (~0u << (fl + 1)) : 0;
+        if (!flMap) {
+            return NONE;
+        }
+        fl = lowestBit(flMap);
+        slMap = secondLevel[fl];
+    }
+    return freeHeads[fl][lowestBit(slMap)];
+}
+
+int MeshPool::takeFrom(int block, GLsizei size) {
+    removeFree(block);
+    if (blocks[block].size > size) {
+        int rest = newBlock();
+        Block& b = blocks[block];
+        Block& r = blocks[rest];
+        r.offset = b.offset + size;
+        r.size = b.size - size;
+        r.free = true;
+        r.prevPhysical = block;
+        r.nextPhysical = b.nextPhysical;
+        if (b.nextPhysical != NONE) {
+            blocks[b.nextPhysical].prevPhysical = rest;
+        } else {
+            lastBlock = rest;
+        }
+        b.nextPhysical = rest;
+        b.size = size;
+        insertFree(rest);
+    }
+    blocks[block].free = false;
+    return block;
+}
+
+void MeshPool::release(int block) {
+    blocks[block].free = true;
+    blocks[block].handle = ~0u;
+
+    // Absorb a free range after, then let a free range before absorb this one
+    int next = blocks[block].nextPhysical;
+    if (next != NONE && blocks[next].free) {
+        removeFree(next);
+        blocks[block].size += blocks[next].size;
+        blocks[block].nextPhysical = blocks[next].nextPhysical;
+        if (blocks[next].nextPhysical != NONE) {
+            blocks[blocks[next].nextPhysical].prevPhysical = block;
+        } else {
+            lastBlock = block;
+        }
+        unusedBlocks.push_back(next);
+    }
+    int previous = blocks[block].prevPhysical;
+    if (previous != NONE && blocks[previous].free) {
+        removeFree(previous);
+        blocks[previous].size += blocks[block].size;
+        blocks[previous].nextPhysical = blocks[block].nextPhysical;
+        if (blocks[block].nextPhysical != NONE) {
+            blocks[blocks[block].nextPhysical].prevPhysical = previous;
+        } else {
+            lastBlock = previous;
+        }
+        unusedBlocks.push_back(block);
+        block = previous;
+    }
+    insertFree(block);
+}
+
+bool MeshPool::allocate(const ChunkVertex* vertices, GLsizei count, Allocation& allocation) {
+    int block = findFree(count);
+    if (block == NONE) {
+        if (!grow(count)) {
+            return false;
+        }
+        block = findFree(count);
+    }
+    block = takeFrom(block, count);
+
+    uint32_t handle;
+    if (!unusedHandles.empty()) {
+        handle = unusedHandles.back();
+        unusedHandles.pop_back();
+        handles[handle] = block;
+    } else {
+        handle = static_cast<uint32_t>(handles.size());
+        handles.push_back(block);
+    }
+    blocks[block].handle = handle;
+    allocation.handle = handle;
+    allocation.vertexCount = count;
+    poolStats.usedBytes += static_cast<size_t>(count) * sizeof(ChunkVertex);
+    updateLargestFree();
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(blocks[block].offset) * sizeof(ChunkVertex),
+                    static_cast<GLsizeiptr>(count) * sizeof(ChunkVertex), vertices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return true;
+}
+
+void MeshPool::free(Allocation& allocation) {
+    if (allocation.vertexCount == 0) {
+        return;
+    }
+    release(handles[allocation.handle]);
+    handles[allocation.handle] = NONE;
+    unusedHandles.push_back(allocation.handle);
+    poolStats.usedBytes -= static_cast<size_t>(allocation.vertexCount) * sizeof(ChunkVertex);
+    allocation = Allocation();
+    updateLargestFree();
+}
+
+void MeshPool::compact(float threshold, GLsizeiptr maxBytes) {
+    if (poolStats.fragmentation() <= threshold) {
+        return;
+    }
+    double start = nowMs();
+    glBindBuffer(GL_COPY_READ_BUFFER, bufferID);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+
+    // Move the highest mesh into a hole below it; meshes that don't fit anywhere lower are
+    // passed over, a bounded number of times so a frame can't spin on them
+    GLsizeiptr moved = 0;
+    int skipped = 0;
+    int candidate = lastBlock;
+    while (candidate != NONE && moved < maxBytes && skipped < 64) {
+        if (blocks[candidate].free) {
+            candidate = blocks[candidate].prevPhysical;
+            continue;
+        }
+        GLsizei size = blocks[candidate].size;
+        int target = findFree(size);
+        if (target == NONE || blocks[target].offset > blocks[candidate].offset) {
+            ++skipped;
+            candidate = blocks[candidate].prevPhysical;
+            continue;
+        }
+
+        // Source and destination are separate ranges of the same buffer, which the copy allows
+        target = takeFrom(target, size);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(blocks[candidate].offset) * sizeof(ChunkVertex),
+                            static_cast<GLintptr>(blocks[target].offset) * sizeof(ChunkVertex), static_cast<GLsizeiptr>(size) * sizeof(ChunkVertex));
+        uint32_t handle = blocks[candidate].handle;
+        handles[handle] = target;
+        blocks[target].handle = handle;
+        release(candidate);
+
+        moved += static_cast<GLsizeiptr>(size) * sizeof(ChunkVertex);
+        ++poolStats.moves;
+        candidate = lastBlock;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    poolStats.movedBytes += moved;
+    poolStats.compactMs += nowMs() - start;
+    updateLargestFree();
+}
+
+bool MeshPool::grow(GLsizei minimum) {
+    // Twice what's asked for, so the rounding in findFree() still finds it
+    GLsizei oldCapacity = capacity;
+    GLsizei newCapacity = capacity;
+    while (newCapacity - oldCapacity < minimum * 2) {
+        newCapacity *= 2;
+    }
+
+    GLuint newBuffer;
+    glGenBuffers(1, &newBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(newCapacity) * sizeof(ChunkVertex), NULL, GL_DYNAMIC_DRAW);
+    if (glGetError() == GL_OUT_OF_MEMORY) {
+        std::cerr << "Chunk mesh pool can't grow to " << newCapacity * sizeof(ChunkVertex) / (1024 * 1024) << " MB" << std::endl;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &newBuffer);
+        return false;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, bufferID);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(oldCapacity) * sizeof(ChunkVertex));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &bufferID);
+    bufferID = newBuffer;
+    capacity = newCapacity;
+    poolStats.capacityBytes = static_cast<size_t>(capacity) * sizeof(ChunkVertex);
+    ++poolStats.grows;
+
+    // The new space goes on the end, merging with a free range that ran up to the old end
+    int tail = newBlock();
+    blocks[tail].offset = oldCapacity;
+    blocks[tail].size = newCapacity - oldCapacity;
+    blocks[tail].prevPhysical = lastBlock;
+    blocks[lastBlock].nextPhysical = tail;
+    lastBlock = tail;
+    release(tail);
+    updateLargestFree();
+    std::cout << "Chunk mesh pool grown to " << poolStats.capacityBytes / (1024 * 1024) << " MB" << std::endl;
+    return true;
+}
+
+void MeshPool::updateLargestFree() {
+    // The largest free range is in the highest non-empty class; only that list needs a look
+    size_t largest = 0;
+    if (firstLevel) {
+        int fl = highestBit(firstLevel);
+        for (int block = freeHeads[fl][highestBit(secondLevel[fl])]; block != NONE; block = blocks[block].nextFree) {
+            largest = std::max(largest, static_cast<size_t>(blocks[block].size));
+        }
+    }
+    poolStats.largestFreeBytes = largest * sizeof(ChunkVertex);
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+#include <vector>
+#include "chunkmesher.h"
+
+struct MeshPoolStats {
+    size_t capacityBytes = 0;
+    size_t usedBytes = 0;
+    size_t largestFreeBytes = 0;
+    unsigned int grows = 0;
+    unsigned long long moves = 0;      // Meshes moved by compaction
+    unsigned long long movedBytes = 0;
+    double compactMs = 0.0;            // CPU time spent issuing compaction, all frames
+
+    // Share of the free space that isn't part of the largest free range: 0 when all
+    // free space is one range, near 1 when it is scattered in small holes
+    float fragmentation() const {
+        size_t freeBytes = capacityBytes - usedBytes;
+        return freeBytes ? 1.0f - static_cast<float>(largestFreeBytes) / freeBytes : 0.0f;
+    }
+};
+
+// One vertex buffer that every chunk and LOD cell mesh is suballocated from,
+// so all of them can be drawn from a single VAO binding and addressed by base
+// vertex. Space is managed with a TLSF allocator (two-level segregated fit):
+// free ranges are binned by size class, with a bitmap per level, so finding
+// and freeing a range are O(1) and frees merge with free neighbours straight
+// away. Churn from streaming still leaves holes, so compact() moves the meshes
+// nearest the end of the buffer down into holes with glCopyBufferSubData, a
+// bounded number of bytes per frame, until the free space is one range again.
+// Meshes are referred to by handle since compaction changes their offsets.
+// When nothing fits the buffer doubles, copying the old contents on the GPU.
+class MeshPool {
+public:
+    struct Allocation {
+        uint32_t handle = ~0u;
+        GLsizei vertexCount = 0; // 0 when nothing is allocated
+    };
+
+    bool create(GLsizeiptr vertices);
+    void destroy();
+
+    // Reserves space for the vertices and uploads them; false if the buffer can't grow
+    bool allocate(const ChunkVertex* vertices, GLsizei count, Allocation& allocation);
+    // Returns the space to the pool and clears the allocation
+    void free(Allocation& allocation);
+    // Where the mesh currently starts; valid until the next compact()
+    GLint firstVertex(const Allocation& allocation) const { return blocks[handles[allocation.handle]].offset; }
+
+    // Moves meshes towards the start of the buffer while the free space is more
+    // fragmented than threshold, copying at most maxBytes
+    void compact(float threshold, GLsizeiptr maxBytes);
+
+    GLuint buffer() const { return bufferID; }
+    const MeshPoolStats& stats() const { return poolStats; }
+
+private:
+    static const int SL_LOG2 = 4; // 16 second-level classes per power of two
+    static const int SL_COUNT = 1 << SL_LOG2;
+    static const int FL_COUNT = 32;
+    static const int NONE = -1;
+
+    // A range of the buffer, free or in use, in the list of ranges ordered by offset
+    struct Block {
+        GLint offset = 0;
+        GLsizei size = 0;
+        bool free = false;
+        int prevPhysical = NONE, nextPhysical = NONE;
+        int prevFree = NONE, nextFree = NONE; // Within its size class, when free
+        uint32_t handle = ~0u;               // When in use
+    };
+
+    static void mapping(GLsizei size, int& fl, int& sl);
+    int newBlock();
+    void insertFree(int block);
+    void removeFree(int block);
+    int findFree(GLsizei size) const;
+    // Takes size vertices from the front of a free block, returning the block now in use
+    int takeFrom(int block, GLsizei size);
+    // Marks a block free and merges it with free neighbours
+    void release(int block);
+    bool grow(GLsizei minimum);
+    void updateLargestFree();
+
+    GLuint bufferID = 0;
+    GLsizei capacity = 0; // In vertices
+    std::vector<Block> blocks;
+    std::vector<int> unusedBlocks;
+    int lastBlock = NONE; // Highest offset
+    uint32_t firstLevel = 0;
+    uint32_t secondLevel[FL_COUNT] = {};
+    int freeHeads[FL_COUNT][SL_COUNT];
+
+    std::vector<int> handles; // Handle -> block
+    std::vector<uint32_t> unusedHandles;
+    MeshPoolStats poolStats;
+};
@@ -0,0 +1,310 @@
+#include "occlusionculler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+const int TILES_X = OCCLUSION_WIDTH / OCCLUSION_TILE;
+const int TILES_Y = OCCLUSION_HEIGHT / OCCLUSION_TILE;
+const int BAND_HEIGHT = OCCLUSION_HEIGHT / OCCLUSION_BANDS;
+const int TEST_BLOCK = 64; // Boxes per parallelFor job
+const float DEPTH_BIAS = 1.0001f; // Keeps an occluder lying on a box's face from hiding it
+
+static_assert(OCCLUSION_WIDTH % 4 == 0, "rows are rasterised four pixels at a time");
+static_assert(BAND_HEIGHT % OCCLUSION_TILE == 0, "bands must cover whole tile rows");
+
+double nowMs() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Four floats processed together. Comparisons return all-ones lanes as masks.
+#if defined(__SSE2__)
+struct Float4 {
+    __m128 v;
+    Float4(__m128 value) : v(value) {}
+    explicit Float4(float value) : v(_mm_set1_ps(value)) {}
+    Float4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+    static Float4 load(const float* p) { return _mm_loadu_ps(p); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+inline Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+inline Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+inline Float4 operator&(Float4 a, Float4 b) { return _mm_and_ps(a.v, b.v); }
+inline Float4 atLeast(Float4 a, Float4 b) { return _mm_cmpge_ps(a.v, b.v); }
+inline Float4 max(Float4 a, Float4 b) { return _mm_max_ps(a.v, b.v); }
+inline Float4 select(Float4 mask, Float4 a, Float4 b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+inline bool any(Float4 mask) { return _mm_movemask_ps(mask.v) != 0; }
+#elif defined(__ARM_NEON)
+struct Float4 {
+    float32x4_t v;
+    Float4(float32x4_t value) : v(value) {}
+    explicit Float4(float value) : v(vdupq_n_f32(value)) {}
+    Float4(float a, float b, float c, float d) {
+        float values[4] = { a, b, c, d };
+        v = vld1q_f32(values);
+    }
+    static Float4 load(const float* p) { return vld1q_f32(p); }
+    void store(float* p) const { vst1q_f32(p, v); }
+};
+inline Float4 operator+(Float4 a, Float4 b) { return vaddq_f32(a.v, b.v); }
+inline Float4 operator*(Float4 a, Float4 b) { return vmulq_f32(a.v, b.v); }
+inline Float4 operator&(Float4 a, Float4 b) {
+    return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a.v), vreinterpretq_u32_f32(b.v)));
+}
+inline Float4 atLeast(Float4 a, Float4 b) { return vreinterpretq_f32_u32(vcgeq_f32(a.v, b.v)); }
+inline Float4 max(Float4 a, Float4 b) { return vmaxq_f32(a.v, b.v); }
+inline Float4 select(Float4 mask, Float4 a, Float4 b) { return vbslq_f32(vreinterpretq_u32_f32(mask.v), a.v, b.v); }
+inline bool any(Float4 mask) { return vmaxvq_u32(vreinterpretq_u32_f32(mask.v)) != 0; }
+#else
+struct Float4 {
+    float v[4];
+    explicit Float4(float value) : v{ value, value, value, value } {}
+    Float4(float a, float b, float c, float d) : v{ a, b, c, d } {}
+    static Float4 load(const float* p) { return Float4(p[0], p[1], p[2], p[3]); }
+    void store(float* p) const { std::copy(v, v + 4, p); }
+};
+inline Float4 operator+(Float4 a, Float4 b) { return Float4(a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]); }
+inline Float4 operator*(Float4 a, Float4 b) { return Float4(a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]); }
+// Masks are 1 or 0 here rather than all-ones lanes
+inline Float4 operator&(Float4 a, Float4 b) { return a * b; }
+inline Float4 atLeast(Float4 a, Float4 b) {
+    return Float4(a.v[0] >= b.v[0], a.v[1] >= b.v[1], a.v[2] >= b.v[2], a.v[3] >= b.v[3]);
+}
+inline Float4 max(Float4 a, Float4 b) {
+    return Float4(std::max(a.v[0], b.v[0]), std::max(a.v[1], b.v[1]), std::max(a.v[2], b.v[2]), std::max(a.v[3], b.v[3]));
+}
+inline Float4 select(Float4 mask, Float4 a, Float4 b) {
+    return Float4(mask.v[0] ? a.v[0] : b.v[0], mask.v[1] ? a.v[1] : b.v[1], mask.v[2] ? a.v[2] : b.v[2], mask.v[3] ? a.v[3] : b.v[3]);
+}
+inline bool any(Float4 mask) { return mask.v[0] || mask.v[1] || mask.v[2] || mask.v[3]; }
+#endif
+
+// Signed distance to the near plane in clip space; positive in front of it
+float nearDistance(const glm::vec4& clip) {
+    return clip.z + clip.w;
+}
+
+} // namespace
+
+OcclusionCuller::OcclusionCuller()
+    : depth(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 0.0f), tileFarthest(TILES_X * TILES_Y, 0.0f) {}
+
+void OcclusionCuller::beginFrame(const glm::mat4& matrix) {
+    viewProjection = matrix;
+    triangles.clear();
+    std::fill(depth.begin(), depth.end(), 0.0f);
+    std::fill(tileFarthest.begin(), tileFarthest.end(), 0.0f);
+    frameStats = OcclusionStats();
+}
+
+void OcclusionCuller::addTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    glm::vec4 clip[3] = { viewProjection * glm::vec4(a, 1.0f), viewProjection * glm::vec4(b, 1.0f),
+                          viewProjection * glm::vec4(c, 1.0f) };
+
+    // Clip against the near plane; one triangle can become a quad
+    glm::vec4 polygon[4];
+    int count = 0;
+    for (int i = 0; i < 3; ++i) {
+        const glm::vec4& from = clip[i];
+        const glm::vec4& to = clip[(i + 1) % 3];
+        float fromDistance = nearDistance(from), toDistance = nearDistance(to);
+        if (fromDistance >= 0.0f) {
+            polygon[count++] = from;
+        }
+        if ((fromDistance >= 0.0f) != (toDistance >= 0.0f)) {
+            float t = fromDistance / (fromDistance - toDistance);
+            polygon[count++] = from + (to - from) * t;
+        }
+    }
+    if (count >= 3) {
+        addClipTriangle(polygon[0], polygon[1], polygon[2]);
+    }
+    if (count == 4) {
+        addClipTriangle(polygon[0], polygon[2], polygon[3]);
+    }
+}
+
+void OcclusionCuller::addBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+    glm::vec3 corner[8];
+    for (int i = 0; i < 8; ++i) {
+        corner[i] = glm::vec3(i & 1 ? boundsMax.x : boundsMin.x, i & 2 ? boundsMax.y : boundsMin.y, i & 4 ? boundsMax.z : boundsMin.z);
+    }
+    // Two triangles per face, corners indexed by the bits above
+    static const int FACES[6][4] = { { 0, 2, 6, 4 }, { 1, 5, 7, 3 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 }, { 0, 1, 3, 2 }, { 4, 6, 7, 5 } };
+    for (const int* face : FACES) {
+        addTriangle(corner[face[0]], corner[face[1]], corner[face[2]]);
+        addTriangle(corner[face[0]], corner[face[2]], corner[face[3]]);
+    }
+}
+
+OcclusionCuller::ScreenVertex OcclusionCuller::toScreen(const glm::vec4& clip) const {
+    float invW = 1.0f / clip.w;
+    return { (clip.x * invW * 0.5f + 0.5f) * OCCLUSION_WIDTH, (clip.y * invW * 0.5f + 0.5f) * OCCLUSION_HEIGHT, invW };
+}
+
+void OcclusionCuller::addClipTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c) {
+    ScreenVertex v[3] = { toScreen(a), toScreen(b), toScreen(c) };
+
+    float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+    if (std::fabs(area) < 1.0e-6f) {
+        return;
+    }
+
+    ScreenTriangle triangle;
+    float minX = std::min({ v[0].x, v[1].x, v[2].x }), maxX = std::max({ v[0].x, v[1].x, v[2].x });
+    float minY = std::min({ v[0].y, v[1].y, v[2].y }), maxY = std::max({ v[0].y, v[1].y, v[2].y });
+    // Pixels whose centres can fall inside, clamped to the buffer
+    triangle.minX = std::max(0, static_cast<int>(std::ceil(minX - 0.5f))) & ~3;
+    triangle.maxX = std::min(OCCLUSION_WIDTH - 1, static_cast<int>(std::floor(maxX - 0.5f)));
+    triangle.minY = std::max(0, static_cast<int>(std::ceil(minY - 0.5f)));
+    triangle.maxY = std::min(OCCLUSION_HEIGHT - 1, static_cast<int>(std::floor(maxY - 0.5f)));
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+        return;
+    }
+
+    // Edge functions, flipped so the inside is positive whatever the winding
+    float sign = area > 0.0f ? 1.0f : -1.0f;
+    for (int i = 0; i < 3; ++i) {
+        const ScreenVertex& from = v[(i + 1) % 3];
+        const ScreenVertex& to = v[(i + 2) % 3];
+        triangle.edgeX[i] = (from.y - to.y) * sign;
+        triangle.edgeY[i] = (to.x - from.x) * sign;
+        triangle.edgeC[i] = (from.x * to.y - from.y * to.x) * sign;
+    }
+
+    // 1/w is linear in screen space; edge i weights vertex i
+    float scale = 1.0f / std::fabs(area);
+    triangle.depthX = triangle.depthY = triangle.depthC = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+        triangle.depthX += triangle.edgeX[i] * v[i].invW * scale;
+        triangle.depthY += triangle.edgeY[i] * v[i].invW * scale;
+        triangle.depthC += triangle.edgeC[i] * v[i].invW * scale;
+    }
+    triangles.push_back(triangle);
+}
+
+void OcclusionCuller::rasterise(WorkerPool& workers) {
+    double start = nowMs();
+    workers.parallelFor(OCCLUSION_BANDS, [this](int band) { rasteriseBand(band); });
+    frameStats.occluderTriangles = static_cast<int>(triangles.size());
+    frameStats.rasteriseMs = nowMs() - start;
+}
+
+void OcclusionCuller::rasteriseBand(int band) {
+    int bandMinY = band * BAND_HEIGHT, bandMaxY = bandMinY + BAND_HEIGHT - 1;
+    const Float4 laneOffset(0.5f, 1.5f, 2.5f, 3.5f);
+    const Float4 zero(0.0f);
+
+    for (const ScreenTriangle& triangle : triangles) {
+        int minY = std::max(triangle.minY, bandMinY), maxY = std::min(triangle.maxY, bandMaxY);
+        if (minY > maxY) {
+            continue;
+        }
+        Float4 edgeX0(triangle.edgeX[0]), edgeX1(triangle.edgeX[1]), edgeX2(triangle.edgeX[2]), depthX(triangle.depthX);
+
+        for (int y = minY; y <= maxY; ++y) {
+            float centreY = y + 0.5f;
+            Float4 row0(triangle.edgeY[0] * centreY + triangle.edgeC[0]);
+            Float4 row1(triangle.edgeY[1] * centreY + triangle.edgeC[1]);
+            Float4 row2(triangle.edgeY[2] * centreY + triangle.edgeC[2]);
+            Float4 rowDepth(triangle.depthY * centreY + triangle.depthC);
+            float* line = depth.data() + y * OCCLUSION_WIDTH;
+
+            for (int x = triangle.minX; x <= triangle.maxX; x += 4) {
+                Float4 centreX = Float4(static_cast<float>(x)) + laneOffset;
+                Float4 inside = atLeast(edgeX0 * centreX + row0, zero) & atLeast(edgeX1 * centreX + row1, zero) &
+                                atLeast(edgeX2 * centreX + row2, zero);
+                if (!any(inside)) {
+                    continue;
+                }
+                Float4 current = Float4::load(line + x);
+                select(inside, max(current, depthX * centreX + rowDepth), current).store(line + x);
+            }
+        }
+    }
+
+    // Refresh the farthest depth of every tile in the band
+    for (int ty = bandMinY / OCCLUSION_TILE; ty <= bandMaxY / OCCLUSION_TILE; ++ty) {
+        for (int tx = 0; tx < TILES_X; ++tx) {
+            float farthest = depth[ty * OCCLUSION_TILE * OCCLUSION_WIDTH + tx * OCCLUSION_TILE];
+            for (int y = 0; y < OCCLUSION_TILE; ++y) {
+                const float* line = depth.data() + (ty * OCCLUSION_TILE + y) * OCCLUSION_WIDTH + tx * OCCLUSION_TILE;
+                farthest = std::min(farthest, *std::min_element(line, line + OCCLUSION_TILE));
+            }
+            tileFarthest[ty * TILES_X + tx] = farthest;
+        }
+    }
+}
+
+bool OcclusionCuller::occluded(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const {
+    float minX = OCCLUSION_WIDTH, maxX = 0.0f, minY = OCCLUSION_HEIGHT, maxY = 0.0f;
+    float nearest = 0.0f; // Largest 1/w of any corner
+    for (int i = 0; i < 8; ++i) {
+        glm::vec3 corner(i & 1 ? boundsMax.x : boundsMin.x, i & 2 ? boundsMax.y : boundsMin.y, i & 4 ? boundsMax.z : boundsMin.z);
+        glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+        if (nearDistance(clip) < 0.0f) {
+            return false; // Crosses the near plane, nothing can be in front of it
+        }
+        ScreenVertex v = toScreen(clip);
+        minX = std::min(minX, v.x);
+        maxX = std::max(maxX, v.x);
+        minY = std::min(minY, v.y);
+        maxY = std::max(maxY, v.y);
+        nearest = std::max(nearest, v.invW);
+    }
+    nearest *= DEPTH_BIAS;
+
+    // Every pixel the box could touch
+    int x0 = std::max(0, static_cast<int>(std::floor(minX))), x1 = std::min(OCCLUSION_WIDTH - 1, static_cast<int>(std::floor(maxX)));
+    int y0 = std::max(0, static_cast<int>(std::floor(minY))), y1 = std::min(OCCLUSION_HEIGHT - 1, static_cast<int>(std::floor(maxY)));
+    if (x0 > x1 || y0 > y1) {
+        return false; // Off screen; that is the frustum's call, not ours
+    }
+
+    for (int ty = y0 / OCCLUSION_TILE; ty <= y1 / OCCLUSION_TILE; ++ty) {
+        for (int tx = x0 / OCCLUSION_TILE; tx <= x1 / OCCLUSION_TILE; ++tx) {
+            if (tileFarthest[ty * TILES_X + tx] > nearest) {
+                continue; // The whole tile is in front of the box
+            }
+            // Only the pixels of this tile inside the box rectangle
+            int px0 = std::max(x0, tx * OCCLUSION_TILE), px1 = std::min(x1, tx * OCCLUSION_TILE + OCCLUSION_TILE - 1);
+            int py0 = std::max(y0, ty * OCCLUSION_TILE), py1 = std::min(y1, ty * OCCLUSION_TILE + OCCLUSION_TILE - 1);
+            for (int y = py0; y <= py1; ++y) {
+                const float* line = depth.data() + y * OCCLUSION_WIDTH;
+                for (int x = px0; x <= px1; ++x) {
+                    if (line[x] <= nearest) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void OcclusionCuller::testBoxes(const glm::vec3* boundsMin, const glm::vec3* boundsMax, int count, unsigned char* visible,
+                                WorkerPool& workers) {
+    double start = nowMs();
+    std::atomic<int> hidden(0);
+    workers.parallelFor((count + TEST_BLOCK - 1) / TEST_BLOCK, [&](int block) {
+        int end = std::min(count, (block + 1) * TEST_BLOCK);
+        int blockHidden = 0;
+        for (int i = block * TEST_BLOCK; i < end; ++i) {
+            bool hiddenBox = occluded(boundsMin[i], boundsMax[i]);
+            visible[i] = !hiddenBox;
+            blockHidden += hiddenBox;
+        }
+        hidden += blockHidden;
+    });
+    frameStats.tested += count;
+    frameStats.occluded += hidden;
+    frameStats.testMs += nowMs() - start;
+}
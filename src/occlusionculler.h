@@ -0,0 +1,71 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include "workerpool.h"
+
+#define OCCLUSION_WIDTH 256  // Depth buffer resolution, 4:3 like the window
+#define OCCLUSION_HEIGHT 192
+#define OCCLUSION_TILE 8     // Pixels along each edge of a depth tile
+#define OCCLUSION_BANDS 8    // Horizontal strips rasterised in parallel
+
+struct OcclusionStats {
+    int occluderTriangles = 0; // Rasterised this frame, after near clipping
+    int tested = 0;            // Boxes tested this frame
+    int occluded = 0;          // Of those, hidden behind occluders
+    double rasteriseMs = 0.0;
+    double testMs = 0.0;
+
+    float rate() const { return tested ? static_cast<float>(occluded) / tested : 0.0f; }
+};
+
+// Occlusion culling done entirely on the CPU, so nothing is ever read back from
+// the GPU. Each frame a handful of conservative occluders (shapes known to be
+// solid, never bigger than what they stand for) are rasterised into a small
+// depth buffer, then bounding boxes are tested against it before they are
+// submitted. Depth is stored as 1/w: larger is nearer, and a cleared buffer (0)
+// hides nothing. Each depth tile also keeps its farthest value so most boxes
+// are decided without looking at single pixels. Rasterisation is split into
+// horizontal bands on the worker pool and does four pixels at a time with SSE
+// or NEON where available.
+class OcclusionCuller {
+public:
+    OcclusionCuller();
+
+    // Clears the depth buffer and the occluder list
+    void beginFrame(const glm::mat4& viewProjection);
+    // World-space occluders; they must lie inside solid geometry
+    void addTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+    void addBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+    // Rasterises every occluder added since beginFrame()
+    void rasterise(WorkerPool& workers);
+
+    // Whether a world-space box is hidden behind the occluders
+    bool occluded(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+    // Tests many boxes in parallel, writing 0 to visible[i] for hidden ones, and
+    // counts them towards this frame's stats
+    void testBoxes(const glm::vec3* boundsMin, const glm::vec3* boundsMax, int count, unsigned char* visible, WorkerPool& workers);
+
+    const OcclusionStats& stats() const { return frameStats; }
+
+private:
+    // Screen-space vertex: pixel position and 1/w
+    struct ScreenVertex {
+        float x, y, invW;
+    };
+    // Set up once when added so every band can rasterise it directly
+    struct ScreenTriangle {
+        int minX, maxX, minY, maxY;               // Pixel bounds, minX a multiple of 4
+        float edgeX[3], edgeY[3], edgeC[3];       // Inside where every edgeX*x + edgeY*y + edgeC >= 0
+        float depthX, depthY, depthC;             // 1/w as a plane over the screen
+    };
+
+    void addClipTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+    ScreenVertex toScreen(const glm::vec4& clip) const;
+    void rasteriseBand(int band);
+
+    glm::mat4 viewProjection;
+    std::vector<ScreenTriangle> triangles; // Kept between frames to reuse the storage
+    std::vector<float> depth;
+    std::vector<float> tileFarthest;       // Smallest 1/w in each tile
+    OcclusionStats frameStats;
+};
@@ -0,0 +1,128 @@
+#include "occlusionqueries.h"
+#include <iostream>
+
+#define QUERY_BOX_MARGIN 0.05f // World units boxes grow by, so they aren't hidden by the faces they enclose
+#define QUERY_NEAR_MARGIN 1.0f // Boxes the eye is this close to are always visible (the near plane would clip them)
+#define QUERY_KEEP_FRAMES 120  // Queries of chunks not tested for this long go back to GL
+
+void OcclusionQueries::create(GLStateCache& state) {
+    target = (GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility) ? GL_ANY_SAMPLES_PASSED_CONSERVATIVE : GL_ANY_SAMPLES_PASSED;
+    std::cout << "Occlusion queries: " << (target == GL_ANY_SAMPLES_PASSED_CONSERVATIVE ? "conservative" : "exact")
+              << " any samples passed" << std::endl;
+
+    // A unit cube the box program stretches between the corners
+    const GLfloat corners[] = { 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 0, 0, 1, 1, 0, 1, 1, 1, 1, 0, 1, 1 };
+    const GLushort indices[] = { 0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+                                 3, 7, 6, 3, 6, 2, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5 };
+    glGenVertexArrays(1, &cubeVAO);
+    state.bindVertexArray(cubeVAO);
+    glGenBuffers(1, &cubeVBO);
+    state.bindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
+    glEnableVertexAttribArray(0);
+    glGenBuffers(1, &cubeEBO);
+    state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    state.bindVertexArray(0);
+    state.bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void OcclusionQueries::destroy() {
+    queries.forEach([](const ChunkCoord&, ChunkQuery& entry) { glDeleteQueries(1, &entry.query); });
+    queries.clear();
+    glDeleteVertexArrays(1, &cubeVAO);
+    glDeleteBuffers(1, &cubeVBO);
+    glDeleteBuffers(1, &cubeEBO);
+}
+
+bool OcclusionQueries::hidden(const ChunkCoord& coord) {
+    // A chunk that wasn't tested last frame (off screen, say) has nothing current to go on
+    ChunkQuery* entry = queries.find(coord);
+    if (!entry || entry->lastTested != frame) {
+        return false;
+    }
+    if (entry->pending) {
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(entry->query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint anySamples = GL_TRUE;
+            glGetQueryObjectuiv(entry->query, GL_QUERY_RESULT, &anySamples);
+            entry->hidden = !anySamples;
+            entry->pending = false;
+            ++queryStats.resultsRead;
+        } else {
+            ++queryStats.resultsPending;
+        }
+    }
+    if (entry->hidden && !entry->near) {
+        ++queryStats.hidden;
+        return true;
+    }
+    return false;
+}
+
+GLuint OcclusionQueries::condition(const ChunkCoord& coord) {
+    ChunkQuery* entry = queries.find(coord);
+    if (!entry || !entry->issued || entry->near || entry->lastTested != frame) {
+        return 0;
+    }
+    ++queryStats.conditional;
+    return entry->query;
+}
+
+void OcclusionQueries::test(const FrameVector<OcclusionBox>& boxes, const glm::vec3& eye, bool reissue, GLStateCache& state,
+                            GLuint program, GLint boxMinLoc, GLint boxMaxLoc) {
+    ++frame;
+
+    // Boxes only test against the depth buffer, and are seen from inside as well as out
+    bool drawing = false;
+    for (const OcclusionBox& box : boxes) {
+        ChunkQuery& entry = queries[box.coord];
+        entry.lastTested = frame;
+        glm::vec3 boundsMin = box.boundsMin - glm::vec3(QUERY_BOX_MARGIN), boundsMax = box.boundsMax + glm::vec3(QUERY_BOX_MARGIN);
+        entry.near = glm::length(glm::clamp(eye, boundsMin, boundsMax) - eye) <= QUERY_NEAR_MARGIN;
+        if (entry.near || (entry.pending && !reissue)) {
+            continue;
+        }
+        if (!drawing) {
+            state.useProgram(program);
+            state.bindVertexArray(cubeVAO);
+            state.polygonMode(GL_FILL);
+            state.disable(GL_CULL_FACE);
+            state.depthMask(GL_FALSE);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            drawing = true;
+        }
+        if (entry.query == 0) {
+            glGenQueries(1, &entry.query);
+        }
+        glUniform3f(boxMinLoc, boundsMin.x, boundsMin.y, boundsMin.z);
+        glUniform3f(boxMaxLoc, boundsMax.x, boundsMax.y, boundsMax.z);
+        glBeginQuery(target, entry.query);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, (void*)0);
+        glEndQuery(target);
+        entry.issued = true;
+        entry.pending = true;
+        ++queryStats.issued;
+    }
+    if (drawing) {
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        state.depthMask(GL_TRUE);
+        state.enable(GL_CULL_FACE);
+    }
+
+    // Give back the queries of chunks that have left the view
+    if (frame % QUERY_KEEP_FRAMES == 0) {
+        FrameVector<ChunkCoord> stale;
+        queries.forEach([&](const ChunkCoord& coord, ChunkQuery& entry) {
+            if (frame - entry.lastTested >= QUERY_KEEP_FRAMES) {
+                glDeleteQueries(1, &entry.query);
+                stale.push_back(coord);
+            }
+        });
+        for (const ChunkCoord& coord : stale) {
+            queries.erase(coord);
+        }
+    }
+}
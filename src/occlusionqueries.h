@@ -0,0 +1,72 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "chunkcoord.h"
+#include "chunkmap.h"
+#include "framearena.h"
+#include "glstate.h"
+
+// How GPU occlusion query results are used
+enum OcclusionQueryMode {
+    OCCLUSION_QUERIES_OFF,
+    OCCLUSION_QUERIES_READBACK,    // Results are read once available and hidden chunks left out of the frame
+    OCCLUSION_QUERIES_CONDITIONAL, // Chunks are drawn under glBeginConditionalRender with their last query
+};
+
+struct OcclusionQueryStats {
+    unsigned long long issued = 0;         // Boxes drawn with a query
+    unsigned long long resultsRead = 0;    // Results read back once available
+    unsigned long long resultsPending = 0; // Checks that found no result yet, so the chunk kept its last state
+    unsigned long long hidden = 0;         // Chunks left out because their last result saw no samples
+    unsigned long long conditional = 0;    // Chunks drawn under conditional rendering
+};
+
+// A box to test, in world space
+struct OcclusionBox {
+    ChunkCoord coord;
+    glm::vec3 boundsMin, boundsMax;
+};
+
+// Occlusion culling on the GPU for when the CPU depth buffer is too coarse.
+// After a frame's geometry is drawn, the bounding box of each chunk that
+// survived the other culling is drawn with colour and depth writes off inside
+// an any-samples-passed query (conservative where GL 4.3 or
+// ARB_ES3_compatibility allow). The next frame uses the result either by
+// reading it back only once GL reports it available, or by drawing the chunk
+// under conditional rendering that doesn't wait; neither ever stalls. Hidden
+// chunks come back a frame or two after they become visible.
+class OcclusionQueries {
+public:
+    void create(GLStateCache& state);
+    void destroy();
+
+    // Whether the chunk's last finished test saw nothing. Picks up results that
+    // have arrived without waiting for ones that haven't.
+    bool hidden(const ChunkCoord& coord);
+    // The query to draw the chunk under, or 0 to draw it unconditionally
+    GLuint condition(const ChunkCoord& coord);
+
+    // Draws each box with a query, skipping boxes whose last query is still in
+    // flight unless reissue is set (conditional rendering never reads them).
+    // The program takes the corners from its boxMin and boxMax uniforms.
+    void test(const FrameVector<OcclusionBox>& boxes, const glm::vec3& eye, bool reissue, GLStateCache& state, GLuint program,
+              GLint boxMinLoc, GLint boxMaxLoc);
+
+    const OcclusionQueryStats& stats() const { return queryStats; }
+
+private:
+    struct ChunkQuery {
+        GLuint query = 0;
+        bool issued = false;  // Has a result to use, or will have
+        bool pending = false; // Result not read back yet
+        bool hidden = false;
+        bool near = false;    // The eye was at the box last frame, so it wasn't tested
+        unsigned long long lastTested = 0;
+    };
+
+    ChunkMap<ChunkQuery> queries;
+    unsigned long long frame = 0;
+    GLenum target = GL_ANY_SAMPLES_PASSED;
+    GLuint cubeVAO = 0, cubeVBO = 0, cubeEBO = 0;
+    OcclusionQueryStats queryStats;
+};
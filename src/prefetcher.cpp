@@ -0,0 +1,100 @@
+#include "prefetcher.h"
+#include <algorithm>
+#include <cmath>
+
+#define PREFETCH_HEADING_TOLERANCE 0.985f // Cosine of the turn (about 10 degrees) that rebuilds the requests
+#define PREFETCH_SPEED_TOLERANCE 0.25f    // Relative speed change that rebuilds them
+
+namespace {
+
+ChunkCoord chunkAt(const glm::vec3& position) {
+    return std::make_pair(static_cast<int>(std::floor(position.x / CHUNK_SIZE)),
+                          static_cast<int>(std::floor(position.z / CHUNK_SIZE)));
+}
+
+} // namespace
+
+void ChunkPrefetcher::update(const glm::vec3& position, const glm::vec3& front, double time) {
+    if (lastTime < 0.0) {
+        lastPosition = position;
+        lastTime = time;
+        return;
+    }
+
+    // Smooth the velocity over a few frames so a single jittery frame doesn't matter
+    float deltaTime = static_cast<float>(time - lastTime);
+    if (deltaTime > 0.0f) {
+        glm::vec3 current = (position - lastPosition) / deltaTime;
+        velocity = velocity * 0.8f + current * 0.2f;
+    }
+    lastPosition = position;
+    lastTime = time;
+
+    float speed = glm::length(velocity);
+    if (speed < 0.01f) {
+        pending.clear(); // Standing still; nothing new will come into view
+        built = false;
+        return;
+    }
+    glm::vec3 heading = velocity / speed;
+    ChunkCoord chunk = chunkAt(position);
+    if (!pathChanged(chunk, heading, front, speed)) {
+        return;
+    }
+    built = true;
+    builtChunk = chunk;
+    builtHeading = heading;
+    builtFront = front;
+    builtSpeed = speed;
+
+    // Movement follows Front once the camera settles, so look down both paths
+    pending.clear();
+    projectPath(position, heading, speed);
+    projectPath(position, front, speed);
+
+    // Keep the earliest predicted arrival per chunk, then highest priority first
+    earliest.clear();
+    for (const PrefetchRequest& request : pending) {
+        const PrefetchRequest* previous = earliest.find(request.coord);
+        if (!previous || request.arrivalTime < previous->arrivalTime) {
+            earliest[request.coord] = request;
+        }
+    }
+    pending.clear();
+    earliest.forEach([&](const ChunkCoord&, const PrefetchRequest& request) { pending.push_back(request); });
+    std::sort(pending.begin(), pending.end(), [](const PrefetchRequest& a, const PrefetchRequest& b) {
+        return a.priority > b.priority;
+    });
+}
+
+bool ChunkPrefetcher::pathChanged(const ChunkCoord& chunk, const glm::vec3& heading, const glm::vec3& front, float speed) const {
+    return !built || chunk != builtChunk || glm::dot(heading, builtHeading) < PREFETCH_HEADING_TOLERANCE ||
+           glm::dot(front, builtFront) < PREFETCH_HEADING_TOLERANCE || std::abs(speed - builtSpeed) > PREFETCH_SPEED_TOLERANCE * builtSpeed;
+}
+
+void ChunkPrefetcher::projectPath(const glm::vec3& position, const glm::vec3& direction, float speed) {
+    ChunkCoord current = chunkAt(position);
+    ChunkCoord previous = current;
+    float distance = speed * lookaheadSeconds;
+    float step = CHUNK_SIZE * 0.5f;
+
+    for (float travelled = step; travelled <= distance; travelled += step) {
+        ChunkCoord centre = chunkAt(position + direction * travelled);
+        if (centre == previous) {
+            continue;
+        }
+        float arrivalTime = travelled / speed;
+        float priority = 1.0f / (1.0f + arrivalTime);
+
+        // Only the edge this step adds to the window, and of that only what isn't in view already
+        edge.clear();
+        windowDifference(centre, previous, viewRadius, edge);
+        for (const ChunkCoord& coord : edge) {
+            if (std::abs(coord.first - current.first) <= viewRadius && std::abs(coord.second - current.second) <= viewRadius) {
+                continue;
+            }
+            pending.push_back({ coord, arrivalTime, priority });
+        }
+        previous = centre;
+    }
+}
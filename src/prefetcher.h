@@ -0,0 +1,53 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include "chunk.h"
+#include "chunkgrid.h"
+#include "chunkmap.h"
+
+struct PrefetchRequest {
+    ChunkCoord coord;
+    float arrivalTime = 0.0f; // Seconds until the chunk is predicted to come into view
+    float priority = 0.0f;    // Decays with arrival time; requests are sorted highest first
+};
+
+struct PrefetchStats {
+    unsigned long long scheduled = 0;    // Prefetch builds carried out
+    unsigned long long hits = 0;         // Chunks drawn for the first time that had been prefetched
+    unsigned long long demandBuilds = 0; // Chunks that had to be built the frame they were drawn
+};
+
+// Predicts where the camera is heading so chunk work can start before the
+// camera gets there. The position is projected a few seconds ahead, both along
+// the smoothed velocity and along Front, and every chunk that would enter the
+// view neighbourhood on the way becomes a request. Each step along a path only
+// adds the edge the window gains over the step before, and the requests are
+// only rebuilt when the camera chunk, heading or speed changes noticeably.
+class ChunkPrefetcher {
+public:
+    float lookaheadSeconds = 2.0f;
+    int viewRadius = 1; // Chebyshev radius in chunks of the neighbourhood drawn around the camera
+
+    void update(const glm::vec3& position, const glm::vec3& front, double time);
+    const std::vector<PrefetchRequest>& requests() const { return pending; }
+
+    PrefetchStats stats;
+
+private:
+    void projectPath(const glm::vec3& position, const glm::vec3& direction, float speed);
+    // Whether the paths differ enough from the ones the requests were built from
+    bool pathChanged(const ChunkCoord& chunk, const glm::vec3& heading, const glm::vec3& front, float speed) const;
+
+    glm::vec3 lastPosition = glm::vec3(0.0f);
+    glm::vec3 velocity = glm::vec3(0.0f);
+    double lastTime = -1.0;
+    std::vector<PrefetchRequest> pending;
+    ChunkMap<PrefetchRequest> earliest; // Kept between updates to reuse its storage
+    std::vector<ChunkCoord> edge;       // Chunks one path step adds, likewise
+
+    // What the current requests were built from
+    bool built = false;
+    ChunkCoord builtChunk;
+    glm::vec3 builtHeading = glm::vec3(0.0f), builtFront = glm::vec3(0.0f);
+    float builtSpeed = 0.0f;
+};
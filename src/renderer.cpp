@@ -11,71 +11,94 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "camera.h"
-#include <set>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <mutex>
 #include <vector>
-#define CHUNK_SIZE 16 // Define the chunk size
+#define FRAME_UNIFORM_BINDING 0 // Uniform buffer binding point for FrameData
+#define FRAME_STREAM_SIZE (1024 * 1024) // Bytes of streamed data per frame
+#define SHADER_CACHE_DIR "cache/shaders" // Where linked program binaries are kept between runs
+#define CHUNK_MESH_POOL_VERTICES (8 * 1024 * 1024) // Starting size of the shared chunk vertex buffer, 32 MB
 
-// vertex buffer object
-unsigned int cubeVBO, cubeVAO, terrainVBO, terrainVAO, shaderProgram;
+// Sort key fields of the draws in the render queue. Opaque faces come first so the
+// wireframe pass is depth tested against them.
+enum DrawPass { DRAW_PASS_OPAQUE, DRAW_PASS_WIREFRAME };
+enum DrawProgram { DRAW_PROGRAM_CHUNK, DRAW_PROGRAM_TERRAIN };
+enum DrawMaterial { DRAW_MATERIAL_FILL, DRAW_MATERIAL_OUTLINE };
+
+// Matches the std140 FrameData block in vertexShader.vert
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+};
 
 extern Camera camera;
 
 void Renderer::initialise() {
-    // Define vertices for a 3D cube (counter-clockwise order)
-    float vertices[] = {
-        // Front face
-        -0.5f, -0.5f,  0.5f,  0.5f, -0.5f,  0.5f,  0.5f,  0.5f,  0.5f,
-         0.5f,  0.5f,  0.5f, -0.5f,  0.5f,  0.5f, -0.5f, -0.5f,  0.5f,
-
-        // Back face
-        -0.5f, -0.5f, -0.5f, -0.5f,  0.5f, -0.5f,  0.5f,  0.5f, -0.5f,
-         0.5f,  0.5f, -0.5f,  0.5f, -0.5f, -0.5f, -0.5f, -0.5f, -0.5f,
-
-        // Left face
-        -0.5f,  0.5f,  0.5f, -0.5f,  0.5f, -0.5f, -0.5f, -0.5f, -0.5f,
-        -0.5f, -0.5f, -0.5f, -0.5f, -0.5f,  0.5f, -0.5f,  0.5f,  0.5f,
-
-        // Right face
-         0.5f,  0.5f,  0.5f,  0.5f, -0.5f,  0.5f,  0.5f, -0.5f, -0.5f,
-         0.5f, -0.5f, -0.5f,  0.5f,  0.5f, -0.5f,  0.5f,  0.5f,  0.5f,
-
-        // Top face
-        -0.5f,  0.5f, -0.5f, -0.5f,  0.5f,  0.5f,  0.5f,  0.5f,  0.5f,
-         0.5f,  0.5f,  0.5f,  0.5f,  0.5f, -0.5f, -0.5f,  0.5f, -0.5f,
-
-        // Bottom face (updated to counter-clockwise order)
-        -0.5f, -0.5f, -0.5f,  0.5f, -0.5f, -0.5f,  0.5f, -0.5f,  0.5f,
-         0.5f, -0.5f,  0.5f, -0.5f, -0.5f,  0.5f, -0.5f, -0.5f, -0.5f
-    };
-
-    // Generate and bind Vertex Array Object (VAO) for the cube
-    glGenVertexArrays(1, &cubeVAO);
-    glBindVertexArray(cubeVAO);
-
-    // Generate and bind the Vertex Buffer Object (VBO) for the cube
-    glGenBuffers(1, &cubeVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glState.setValidation(config.validateGLState);
 
-    // Define vertex attribute pointer for the cube
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    // Chunk meshes share one VAO and one vertex buffer; draws pick their mesh by base vertex.
+    // Attributes 1 and 2 carry each draw's origin and outline colour, one element per instance.
+    chunkMeshes.create(CHUNK_MESH_POOL_VERTICES);
+    chunkResidency.setMeshPool(chunkMeshes);
+    glGenVertexArrays(1, &chunkVAO);
+    glState.bindVertexArray(chunkVAO);
     glEnableVertexAttribArray(0);
+    glVertexAttribDivisor(1, 1);
+    glVertexAttribDivisor(2, 1);
+    multiDrawIndirect = (GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect) && (GLEW_VERSION_4_2 || GLEW_ARB_base_instance);
+    std::cout << "Chunk draws: " << (multiDrawIndirect ? "multi-draw indirect" : "one multi-draw per mesh") << std::endl;
 
-    // Load and compile shaders
-    shaderProgram = loadShaders("shaders/vertexShader.vert", "shaders/fragmentShader.frag");
-    if (shaderProgram == 0) {
-        std::cerr << "Failed to load shaders." << std::endl;
-        return;
+    // Every chunk draws quads with the same index pattern, so one index buffer serves them all
+    std::vector<GLushort> quadIndices;
+    quadIndices.reserve(MAX_CHUNK_FACES * 6);
+    for (int quad = 0; quad < MAX_CHUNK_FACES; ++quad) {
+        GLushort first = static_cast<GLushort>(quad * 4);
+        GLushort indices[] = { first, GLushort(first + 1), GLushort(first + 2), first, GLushort(first + 2), GLushort(first + 3) };
+        quadIndices.insert(quadIndices.end(), indices, indices + 6);
+    }
+    glGenBuffers(1, &quadIndexEBO);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadIndexEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, quadIndices.size() * sizeof(GLushort), quadIndices.data(), GL_STATIC_DRAW);
+    glState.bindVertexArray(0);
+    for (OverdrawQuery& query : overdrawQueries) {
+        glGenQueries(1, &query.query);
     }
 
+    // Load shaders from the binary cache, or start compiling them in the background
+    shaderCache.initialise(SHADER_CACHE_DIR);
+    mainShader = shaderCache.request("shaders/vertexShader.vert", "shaders/fragmentShader.frag");
+    chunkShader = shaderCache.request("shaders/chunk.vert", "shaders/chunk.frag");
+    if (config.occlusionQueries != OCCLUSION_QUERIES_OFF) {
+        boxShader = shaderCache.request("shaders/box.vert", "shaders/box.frag");
+        gpuOcclusion.create(glState);
+    }
+    shaderProgram = chunkProgram = 0;
+    if (config.shaderHotReload) {
+        shaderWatcher.start("shaders");
+    }
+
+    // Frame matrices come from a uniform block backed by the stream buffer
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+    frameStream.create(FRAME_STREAM_SIZE);
+    frameArena().reserve(config.frameArenaBytes);
+
+    chunkGrid.resize(config.viewRadius);
+    workers.start(config.workerThreads);
+    chunkResidency.setBudgets(config.chunkCpuBudget, config.chunkGpuBudget);
+    prefetcher.lookaheadSeconds = config.prefetchLookaheadSeconds;
+    prefetcher.viewRadius = chunkGrid.getRadius();
+
     // Enable depth testing
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LESS); // Default depth test function
+    glState.enable(GL_DEPTH_TEST);
+    glState.depthFunc(GL_LESS); // Default depth test function
 
     // Enable face culling
-    glEnable(GL_CULL_FACE);
-    glCullFace(GL_BACK);
-    glFrontFace(GL_CCW);
+    glState.enable(GL_CULL_FACE);
+    glState.cullFace(GL_BACK);
+    glState.frontFace(GL_CCW);
 
     // Verify that depth testing and face culling are enabled
     GLint depthTestEnabled, cullFaceEnabled;
@@ -84,27 +107,6 @@ void Renderer::initialise() {
     std::cout << "Depth Test Enabled: " << (depthTestEnabled ? "Yes" : "No") << std::endl;
     std::cout << "Face Culling Enabled: " << (cullFaceEnabled ? "Yes" : "No") << std::endl;
 
-    // Verify shader program
-    if (shaderProgram == 0) {
-        std::cerr << "Shader program failed to load." << std::endl;
-    } else {
-        std::cout << "Shader program loaded successfully." << std::endl;
-    }
-
-    // Verify vertex data for the cube
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-    void* ptr = glMapBuffer(GL_ARRAY_BUFFER, GL_READ_ONLY);
-    if (ptr) {
-        std::cout << "Vertex data loaded successfully." << std::endl;
-        glUnmapBuffer(GL_ARRAY_BUFFER);
-    } else {
-        std::cerr << "Failed to load vertex data." << std::endl;
-    }
-
-    // Unbind the VBO and VAO for the cube to prevent accidental modifications
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-
     // Load height map
     int width, height;
     std::vector<float> heightMap = loadHeightMap("/Users/nicolaiskogstad/[ CUSTOM PROJECTS ]/3DProjection/pics/Tangram Heightmapper (1).png", width, height);
@@ -112,101 +114,878 @@ void Renderer::initialise() {
         return;
     }
 
+    // Keep the heightmap so chunks can be voxelised from it on demand
+    heightField.samples = heightMap;
+    heightField.width = width;
+    heightField.height = height;
+    // Chunks are a single layer of voxels, so taller terrain would be cut flat at the chunk top
+    // under a terrain mesh that keeps rising
+    if (config.terrainHeightScale > CHUNK_SIZE - 1) {
+        std::cerr << "Terrain height scale " << config.terrainHeightScale << " is taller than a chunk, using " << CHUNK_SIZE - 1
+                  << std::endl;
+        config.terrainHeightScale = CHUNK_SIZE - 1;
+    }
+    heightField.heightScale = config.terrainHeightScale;
+
     // Generate terrain vertices
     terrainVertices = generateTerrainVertices(heightMap, width, height);
+    double bvhStart = glfwGetTime();
+    terrain.build(terrainVertices, width, height, &workers);
+    std::cout << "Terrain BVH: " << terrain.tilesX() * terrain.tilesZ() << " tiles built in " << (glfwGetTime() - bvhStart) * 1000.0
+              << " ms, " << terrain.memoryBytes() / 1024 << " KB" << std::endl;
 
     // Generate and bind Vertex Array Object (VAO) for the terrain
     glGenVertexArrays(1, &terrainVAO);
-    glBindVertexArray(terrainVAO);
+    glState.bindVertexArray(terrainVAO);
 
     // Generate and bind the Vertex Buffer Object (VBO) for the terrain
     glGenBuffers(1, &terrainVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, terrainVBO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, terrainVBO);
     glBufferData(GL_ARRAY_BUFFER, terrainVertices.size() * sizeof(float), terrainVertices.data(), GL_STATIC_DRAW);
 
     // Define vertex attribute pointer for the terrain
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
+    // Triangles are indexed tile by tile; the index buffer stays bound to the VAO
+    buildTerrainTiles(width, height);
+    horizonCuller.build(terrainVertices, width, height);
+
     // Unbind the VBO and VAO for the terrain to prevent accidental modifications
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+    glState.bindVertexArray(0);
+}
+
+void Renderer::buildTerrainTiles(int width, int height) {
+    terrainTiles.clear();
+    std::vector<GLuint> indices;
+    indices.reserve(static_cast<size_t>(width - 1) * (height - 1) * 6);
+    auto vertex = [&](int x, int z) {
+        const float* v = &terrainVertices[(static_cast<size_t>(z) * width + x) * 3];
+        return glm::vec3(v[0], v[1], v[2]);
+    };
+
+    // Occluders must never stick out of the terrain, so each coarse vertex takes the
+    // lowest height within one coarse cell of it. Any point of a coarse cell then
+    // lies at or below every terrain vertex around it.
+    int step = std::max(1, config.occluderTerrainStep);
+    auto occluderVertex = [&](int x, int z) {
+        float lowest = vertex(x, z).y;
+        for (int sz = std::max(0, z - step); sz <= std::min(height - 1, z + step); ++sz) {
+            for (int sx = std::max(0, x - step); sx <= std::min(width - 1, x + step); ++sx) {
+                lowest = std::min(lowest, vertex(sx, sz).y);
+            }
+        }
+        return glm::vec3(x, lowest, z);
+    };
+
+    for (int tileZ = 0; tileZ < height - 1; tileZ += TERRAIN_TILE_CELLS) {
+        for (int tileX = 0; tileX < width - 1; tileX += TERRAIN_TILE_CELLS) {
+            int endX = std::min(tileX + TERRAIN_TILE_CELLS, width - 1), endZ = std::min(tileZ + TERRAIN_TILE_CELLS, height - 1);
+            TerrainTile tile;
+            tile.firstIndex = static_cast<GLsizei>(indices.size());
+            tile.boundsMin = glm::vec3(3.0e38f);
+            tile.boundsMax = glm::vec3(-3.0e38f);
+
+            // Same split as the BVH: along the (x, z) to (x + 1, z + 1) diagonal, counter-clockwise from above
+            for (int z = tileZ; z < endZ; ++z) {
+                for (int x = tileX; x < endX; ++x) {
+                    GLuint corner = z * width + x;
+                    GLuint cell[] = { corner, corner + width, corner + width + 1, corner, corner + width + 1, corner + 1 };
+                    indices.insert(indices.end(), cell, cell + 6);
+                }
+            }
+            for (int z = tileZ; z <= endZ; ++z) {
+                for (int x = tileX; x <= endX; ++x) {
+                    tile.boundsMin = glm::min(tile.boundsMin, vertex(x, z));
+                    tile.boundsMax = glm::max(tile.boundsMax, vertex(x, z));
+                }
+            }
+            tile.indexCount = static_cast<GLsizei>(indices.size()) - tile.firstIndex;
+
+            for (int z = tileZ; z < endZ; z += step) {
+                for (int x = tileX; x < endX; x += step) {
+                    int x1 = std::min(x + step, endX), z1 = std::min(z + step, endZ);
+                    glm::vec3 a = occluderVertex(x, z), b = occluderVertex(x, z1), c = occluderVertex(x1, z1), d = occluderVertex(x1, z);
+                    glm::vec3 cell[] = { a, b, c, a, c, d };
+                    tile.occluder.insert(tile.occluder.end(), cell, cell + 6);
+                }
+            }
+            terrainTiles.push_back(std::move(tile));
+        }
+    }
+
+    glGenBuffers(1, &terrainEBO);
+    glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, terrainEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
 }
 
 void Renderer::render() {
+    // Everything transient below comes from the frame arena, so a frame that
+    // streams no new chunks shouldn't reach the heap at all
+    unsigned long long heapAllocations = heapAllocationCount();
+
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    
-    // Using shader program
-    glUseProgram(shaderProgram);
 
-    // View matrix from the camera
+    // Pick up edited shaders and programs that finished building since the last frame
+    for (const std::string& path : shaderWatcher.poll()) {
+        shaderCache.sourceChanged(path);
+    }
+    shaderCache.poll(config.shaderReloadBudgetMs);
+    if (shaderCache.program(mainShader) != shaderProgram) {
+        shaderProgram = shaderCache.program(mainShader);
+        glUniformBlockBinding(shaderProgram, glGetUniformBlockIndex(shaderProgram, "FrameData"), FRAME_UNIFORM_BINDING);
+        colorLoc = glGetUniformLocation(shaderProgram, "color");
+        glState.invalidate(); // A rebuilt program can come back with the old one's name
+    }
+    if (shaderCache.program(chunkShader) != chunkProgram) {
+        chunkProgram = shaderCache.program(chunkShader);
+        glUniformBlockBinding(chunkProgram, glGetUniformBlockIndex(chunkProgram, "FrameData"), FRAME_UNIFORM_BINDING);
+        chunkOutlineLoc = glGetUniformLocation(chunkProgram, "outline");
+        glState.invalidate();
+    }
+    if (boxShader && shaderCache.program(boxShader) != boxProgram) {
+        boxProgram = shaderCache.program(boxShader);
+        glUniformBlockBinding(boxProgram, glGetUniformBlockIndex(boxProgram, "FrameData"), FRAME_UNIFORM_BINDING);
+        boxMinLoc = glGetUniformLocation(boxProgram, "boxMin");
+        boxMaxLoc = glGetUniformLocation(boxProgram, "boxMax");
+        glState.invalidate();
+    }
+    if (shaderProgram == 0 || chunkProgram == 0) {
+        return; // Still compiling, show an empty frame rather than waiting
+    }
+    frameStream.beginFrame();
+    
+    // Write the view and projection matrices straight into this frame's region
+    StreamBuffer::Allocation frame = frameStream.allocate(sizeof(FrameUniforms), uniformAlignment);
+    FrameUniforms* uniforms = static_cast<FrameUniforms*>(frame.ptr);
+    // The mapping is write-only, so keep our own copy for culling
     glm::mat4 view = camera.GetViewMatrix();
+    int reach = config.lodLevels > 0 ? std::max(chunkGrid.getRadius(), config.lodViewRadius) : chunkGrid.getRadius();
+    float farPlane = std::max(100.0f, (reach + 1) * CHUNK_SIZE * 1.5f); // Reach the edge of the grid or the LOD cells
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)800 / (float)600, 0.1f, farPlane);
+    uniforms->view = view;
+    uniforms->projection = projection;
+    glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, frameStream.buffer(), frame.offset, sizeof(FrameUniforms));
+    frameStream.commit(); // Without a persistent mapping this is the upload, and the draws below need it
 
-    // Projection matrix: perspective projection
-    glm::mat4 project = glm::perspective(glm::radians(45.0f), (float)800 / (float)600, 0.1f, 100.0f);
-
-    // Set the matrices in the shader
-    GLint viewLoc = glGetUniformLocation(shaderProgram, "view");
-    GLint projectionLoc = glGetUniformLocation(shaderProgram, "projection");
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(project));
-
-    // Render the cubes
-    glBindVertexArray(cubeVAO);
-    GLint modelLoc = glGetUniformLocation(shaderProgram, "model");
-    GLint colorLoc = glGetUniformLocation(shaderProgram, "color");
-
-    for (const auto& chunk : visitedChunks) {
-        // Set a unique color for each chunk based on its coordinates
-        float outlineColorR = (chunk.first % 2 == 0) ? 1.0f : 0.0f;
-        float outlineColorG = (chunk.second % 2 == 0) ? 1.0f : 0.0f;
-        float outlineColorB = ((chunk.first + chunk.second) % 2 == 0) ? 1.0f : 0.0f;
-
-        for (int x = chunk.first * CHUNK_SIZE; x < (chunk.first + 1) * CHUNK_SIZE; ++x) {
-            for (int y = 0; y < CHUNK_SIZE; ++y) { // Loop over y-axis
-                for (int z = chunk.second * CHUNK_SIZE; z < (chunk.second + 1) * CHUNK_SIZE; ++z) {
-                    glm::mat4 model = glm::mat4(1.0f);
-                    model = glm::translate(model, glm::vec3(x, y, z)); // Include y and z positions
-
-                    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-                    // Drawing the cube faces
-                    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-                    glUniform4f(colorLoc, 0.0f, 0.5f, 0.2f, 1.0f);
-                    glDrawArrays(GL_TRIANGLES, 0, 36);
-
-                    // Drawing the wireframe edges with unique color
-                    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-                    glUniform4f(colorLoc, outlineColorR, outlineColorG, outlineColorB, 1.0f);
-                    glDrawArrays(GL_TRIANGLES, 0, 36);
-
-                    // Resetting the polygon mode
-                    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    ++frameIndex;
+
+    // Take in chunks the workers finished voxelising
+    collectChunks();
+    updateSelection(camera);
+    int meshBuilds = 0;
+
+    // Chunks sealed off from the camera chunk by rock can't be seen from it
+    if (config.connectivityCulling) {
+        chunkVisibility.update(chunkGrid.getCentre(), chunkGrid.getRadius(), camera.Position.y >= CHUNK_SIZE - 0.5f, chunkResidency);
+    }
+
+    // With LOD on, only the middle of the window is drawn at full resolution and cells of
+    // downsampled chunks fill the rings beyond it
+    FrameVector<ChunkCoord> chunkCoords;
+    FrameVector<LodChunk*> visibleLods;
+    if (config.lodLevels > 0) {
+        FrameVector<LodCell> cells;
+        selectLodCells(chunkGrid.getCentre(), chunkGrid.getRadius(), config.lodViewRadius, std::min(config.lodLevels, MAX_LOD_LEVELS), cells);
+        chunkCoords.reserve(chunkGrid.coords().size());
+        visibleLods.reserve(cells.size());
+        int lodRequests = 0, lodMeshBuilds = 0;
+        for (const LodCell& cell : cells) {
+            if (cell.level == 0) {
+                chunkCoords.push_back(cell.cell);
+                continue;
+            }
+            // Missing cells leave a gap over the terrain until a worker has voxelised them
+            LodChunk* lod = chunkResidency.findLod(cell, frameIndex);
+            if (!lod) {
+                if (lodRequests < config.lodBuildsPerFrame && requestLod(cell)) {
+                    ++lodRequests;
+                }
+                continue;
+            }
+            if (!lod->meshed) {
+                if (lodMeshBuilds >= config.lodBuildsPerFrame) {
+                    continue;
                 }
+                buildLodMesh(*lod);
+                ++lodMeshBuilds;
+            }
+            if (lod->faceCount > 0) {
+                visibleLods.push_back(lod);
+            }
+        }
+    } else {
+        chunkCoords.assign(chunkGrid.coords().begin(), chunkGrid.coords().end());
+    }
+
+    // Gather the chunks with something to draw
+    FrameVector<Chunk*> visibleChunks;
+    visibleChunks.reserve(chunkCoords.size());
+    for (const ChunkCoord& coord : chunkCoords) {
+        // Chunks still being voxelised are skipped this frame; meshes are built a few per frame
+        Chunk* chunk = chunkResidency.find(coord, frameIndex);
+        if (!chunk) {
+            if (config.lodLevels > 0) {
+                requestChunk(coord, false); // It was under a LOD cell when it entered the window
+            }
+            continue;
+        }
+        if (config.connectivityCulling && !chunkVisibility.visible(coord)) {
+            ++stats.culledUnreachable;
+            continue;
+        }
+        if (!chunk->meshed) {
+            if (meshBuilds >= config.chunkBuildsPerFrame) {
+                continue;
+            }
+            buildChunkMesh(*chunk);
+            ++meshBuilds;
+        } else if (chunk->stale && meshBuilds < config.chunkBuildsPerFrame) {
+            // The old mesh stays drawable, so stale chunks only use spare budget
+            buildChunkMesh(*chunk);
+            ++meshBuilds;
+        }
+        if (chunk->faceCount == 0) {
+            continue;
+        }
+        if (!chunk->drawn) {
+            chunk->drawn = true;
+            if (chunk->prefetched) {
+                ++prefetcher.stats.hits;
+            }
+        }
+        visibleChunks.push_back(chunk);
+    }
+    FrameVector<const TerrainTile*> visibleTiles;
+    cullBoxes(projection * view, camera.Position, visibleChunks, visibleTiles, visibleLods);
+
+    // Every visible range of every mesh becomes one indirect draw command
+    ChunkDrawList chunkDraws;
+    size_t meshCount = visibleChunks.size() + visibleLods.size();
+    chunkDraws.commands.reserve(meshCount * 3);
+    chunkDraws.instances.reserve(meshCount);
+    chunkDraws.firstCommands.reserve(meshCount + 1);
+    chunkDraws.conditions.reserve(meshCount);
+    FrameVector<OcclusionBox> queryBoxes;
+    queryBoxes.reserve(config.occlusionQueries != OCCLUSION_QUERIES_OFF ? visibleChunks.size() : 0);
+    FrameVector<float> meshDepths;
+    meshDepths.reserve(meshCount);
+    // Distance to the nearest point of the box, as a share of the view distance
+    auto depthOf = [&](const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+        glm::vec3 nearest = glm::clamp(camera.Position, boundsMin, boundsMax);
+        return glm::length(nearest - camera.Position) / farPlane;
+    };
+    for (const Chunk* chunk : visibleChunks) {
+        const ChunkCoord& coord = chunk->coord;
+        glm::vec3 chunkMin, chunkMax;
+        if (!voxels.chunkBounds(coord, chunkMin, chunkMax)) {
+            chunkMin = glm::vec3(coord.first * CHUNK_SIZE, 0.0f, coord.second * CHUNK_SIZE) - glm::vec3(0.5f);
+            chunkMax = chunkMin + glm::vec3(CHUNK_SIZE);
+        }
+        // Corner (0, 0, 0) is half a voxel below the first voxel's centre
+        glm::vec3 origin = glm::vec3(coord.first * CHUNK_SIZE, 0.0f, coord.second * CHUNK_SIZE) - glm::vec3(0.5f);
+
+        // Chunks the GPU saw hidden last time are left out or drawn on its word, and retested after this frame
+        GLuint condition = 0;
+        if (config.occlusionQueries != OCCLUSION_QUERIES_OFF) {
+            OcclusionBox box = { coord, chunkMin, chunkMax };
+            queryBoxes.push_back(box);
+            if (config.occlusionQueries == OCCLUSION_QUERIES_READBACK && gpuOcclusion.hidden(coord)) {
+                continue;
+            }
+            if (config.occlusionQueries == OCCLUSION_QUERIES_CONDITIONAL) {
+                condition = gpuOcclusion.condition(coord);
             }
         }
+        if (queueChunkMesh(chunk->mesh, chunk->faceCount, chunk->faceRanges, chunkMin, chunkMax, origin, 1.0f, coord, condition, chunkDraws)) {
+            meshDepths.push_back(depthOf(chunkMin, chunkMax));
+        }
+    }
+    for (const LodChunk* lod : visibleLods) {
+        if (queueChunkMesh(lod->mesh, lod->faceCount, lod->faceRanges, lod->boundsMin, lod->boundsMax, lod->origin(), lod->scale(),
+                           lod->cell.cell, 0, chunkDraws)) {
+            meshDepths.push_back(depthOf(lod->boundsMin, lod->boundsMax));
+            ++stats.lodDraws;
+        }
     }
+    chunkDraws.firstCommands.push_back(static_cast<GLuint>(chunkDraws.commands.size()));
 
-    // Render the terrain
-    glBindVertexArray(terrainVAO);
-    glm::mat4 model = glm::mat4(1.0f);
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glDrawArrays(GL_TRIANGLES, 0, terrainVertices.size() / 3);
+    // Queue the faces and outlines of each mesh, then the terrain tiles. Items below the
+    // mesh count are meshes, the rest are tiles.
+    GLuint meshesQueued = static_cast<GLuint>(chunkDraws.instances.size());
+    RenderQueue queue;
+    queue.reserve(meshesQueued * 2 + visibleTiles.size());
+    for (GLuint mesh = 0; mesh < meshesQueued; ++mesh) {
+        queue.push(DRAW_PASS_OPAQUE, DRAW_PROGRAM_CHUNK, DRAW_MATERIAL_FILL, meshDepths[mesh], mesh);
+        queue.push(DRAW_PASS_WIREFRAME, DRAW_PROGRAM_CHUNK, DRAW_MATERIAL_OUTLINE, meshDepths[mesh], mesh);
+    }
+    for (size_t tile = 0; tile < visibleTiles.size(); ++tile) {
+        const TerrainTile* terrainTile = visibleTiles[tile];
+        queue.push(DRAW_PASS_OPAQUE, DRAW_PROGRAM_TERRAIN, DRAW_MATERIAL_FILL, depthOf(terrainTile->boundsMin, terrainTile->boundsMax),
+                   meshesQueued + static_cast<GLuint>(tile));
+    }
 
-    glBindVertexArray(0);
+    // Gather order is what drawing without the queue would do; comparing frames alternate
+    bool sorted = config.sortDraws && !(config.compareDrawOrder && (frameIndex & 1));
+    stats.unsortedStateChanges += queue.stateChanges();
+    if (sorted) {
+        queue.sort();
+    }
+    stats.drawStateChanges += queue.stateChanges();
 
-    // Debug: Check for OpenGL errors
+    // Count the samples that pass the depth test, unless the query from this slot is still in flight
+    collectOverdraw();
+    OverdrawQuery& overdraw = overdrawQueries[frameIndex % OVERDRAW_QUERIES];
+    bool measureOverdraw = !overdraw.pending;
+    if (measureOverdraw) {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        overdraw.pixels = static_cast<unsigned long long>(viewport[2]) * viewport[3];
+        overdraw.sorted = sorted;
+        glBeginQuery(GL_SAMPLES_PASSED, overdraw.query);
+    }
+    submitDraws(queue, chunkDraws, visibleTiles);
+    if (measureOverdraw) {
+        glEndQuery(GL_SAMPLES_PASSED);
+        overdraw.pending = true;
+    }
+
+    // Test the chunk boxes against this frame's depth for the next frame. Conditional
+    // rendering never reads results back, so every box gets a fresh query.
+    if (boxProgram && !queryBoxes.empty()) {
+        gpuOcclusion.test(queryBoxes, camera.Position, config.occlusionQueries == OCCLUSION_QUERIES_CONDITIONAL, glState, boxProgram,
+                          boxMinLoc, boxMaxLoc);
+    }
+
+    // Bindings are left in place: the next frame's draws mostly want the same ones
+    frameStream.endFrame();
+
+    // Load and mesh chunks the camera is heading towards, most urgent first, within the per-frame budget
+    prefetcher.update(camera.Position, camera.Front, glfwGetTime());
+    int prefetchBuilds = 0;
+    for (const PrefetchRequest& request : prefetcher.requests()) {
+        if (prefetchBuilds >= config.prefetchBuildsPerFrame) {
+            break;
+        }
+        // Only peek, so resident chunks ahead keep their age and released state unless built here
+        Chunk* chunk = chunkResidency.peek(request.coord);
+        if (!chunk) {
+            if (requestChunk(request.coord, true)) {
+                ++prefetcher.stats.scheduled;
+                ++prefetchBuilds;
+            }
+        } else if (!chunk->meshed) {
+            chunkResidency.find(request.coord, frameIndex);
+            buildChunkMesh(*chunk);
+            ++prefetchBuilds;
+        }
+    }
+
+    // Keep chunk and LOD cell memory within budget now that this frame's ones are marked as used
+    chunkResidency.trim(camera.Position, frameIndex);
+    for (const ChunkCoord& coord : chunkResidency.evicted()) {
+        voxels.remove(coord);
+    }
+
+    // Close up holes evicted meshes left in the shared vertex buffer, a little per frame
+    chunkMeshes.compact(config.meshCompactThreshold, config.meshCompactBytesPerFrame);
+
+    // Debug: Check the state cache against GL and for OpenGL errors
+    if (config.validateGLState) {
+        glState.validate();
+    }
     GLenum err;
     while ((err = glGetError()) != GL_NO_ERROR) {
         std::cerr << "OpenGL error during rendering: " << err << std::endl;
     }
+
+    ++stats.frames;
+    stats.lastFrameHeapAllocations = heapAllocationCount() - heapAllocations;
+    if (stats.lastFrameHeapAllocations) {
+        ++stats.heapAllocatingFrames;
+    }
 }
 
-void Renderer::updateVisitedChunks(const std::pair<int, int>& chunk) {
-    visitedChunks.clear();
-    for (int dx = -1; dx <= 1; ++dx) {
+bool Renderer::queueChunkMesh(const MeshPool::Allocation& mesh, GLsizei faceCount, const ChunkFaceRanges& faceRanges,
+                              const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec3& origin, float scale,
+                              const ChunkCoord& coord, GLuint condition, ChunkDrawList& draws) {
+    FrameVector<DrawElementsIndirectCommand>& commands = draws.commands;
+    FrameVector<ChunkInstance>& instances = draws.instances;
+    unsigned int directions = frontFacingDirections(camera.Position, boundsMin, boundsMax);
+
+    // Adjacent directions merge into one command
+    size_t firstCommand = commands.size();
+    GLuint submitted = 0, rangeEnd = ~0u;
+    for (int face = 0; face < FACE_COUNT; ++face) {
+        GLuint first = faceRanges.start[face], count = faceRanges.start[face + 1] - first;
+        if (!(directions & (1u << face)) || count == 0) {
+            continue;
+        }
+        submitted += count;
+        if (first == rangeEnd) {
+            commands.back().count += count * 6;
+        } else {
+            // Quad q uses vertices 4q..4q+3 of its mesh, so ranges offset the indices and meshes the vertices
+            DrawElementsIndirectCommand command;
+            command.count = count * 6;
+            command.instanceCount = 1;
+            command.firstIndex = first * 6;
+            command.baseVertex = chunkMeshes.firstVertex(mesh);
+            command.baseInstance = static_cast<GLuint>(instances.size());
+            commands.push_back(command);
+        }
+        rangeEnd = first + count;
+    }
+    stats.chunkFaces += faceCount;
+    stats.chunkFacesSubmitted += submitted;
+    if (commands.size() == firstCommand) {
+        return false;
+    }
+    ++stats.meshDraws;
+    stats.meshVertices += submitted * 4;
+
+    // Set a unique color for each chunk based on its coordinates
+    ChunkInstance instance;
+    instance.origin = glm::vec4(origin, scale);
+    instance.outline[0] = (coord.first % 2 == 0) ? 255 : 0;
+    instance.outline[1] = (coord.second % 2 == 0) ? 255 : 0;
+    instance.outline[2] = ((coord.first + coord.second) % 2 == 0) ? 255 : 0;
+    instance.outline[3] = 255;
+    instances.push_back(instance);
+    draws.firstCommands.push_back(static_cast<GLuint>(firstCommand));
+    draws.conditions.push_back(condition);
+    return true;
+}
+
+void Renderer::submitDraws(const RenderQueue& queue, const ChunkDrawList& draws, const FrameVector<const TerrainTile*>& tiles) {
+    if (queue.size() == 0) {
+        return;
+    }
+    GLuint meshCount = static_cast<GLuint>(draws.instances.size());
+
+    // Split the queue into batches of keys with the same state, laying out each batch's
+    // chunk commands next to each other so the batch is one indirect draw
+    struct Batch {
+        size_t firstKey, endKey;
+        GLuint firstCommand, commandCount;
+    };
+    FrameVector<Batch> batches;
+    FrameVector<DrawElementsIndirectCommand> ordered;
+    ordered.reserve(draws.commands.size() * 2);
+    for (size_t i = 0; i < queue.size(); ++i) {
+        DrawKey key = queue[i];
+        if (i == 0 || RenderQueue::state(key) != RenderQueue::state(queue[i - 1])) {
+            Batch batch;
+            batch.firstKey = i;
+            batch.firstCommand = static_cast<GLuint>(ordered.size());
+            batches.push_back(batch);
+        }
+        if (RenderQueue::program(key) == DRAW_PROGRAM_CHUNK) {
+            GLuint mesh = RenderQueue::item(key);
+            ordered.insert(ordered.end(), draws.commands.begin() + draws.firstCommands[mesh],
+                           draws.commands.begin() + draws.firstCommands[mesh + 1]);
+        }
+        batches.back().endKey = i + 1;
+        batches.back().commandCount = static_cast<GLuint>(ordered.size()) - batches.back().firstCommand;
+    }
+
+    // Commands and per-draw data go through this frame's stream region
+    StreamBuffer::Allocation commandData, instanceData;
+    if (multiDrawIndirect && !ordered.empty()) {
+        commandData = frameStream.allocate(ordered.size() * sizeof(DrawElementsIndirectCommand));
+        instanceData = frameStream.allocate(draws.instances.size() * sizeof(ChunkInstance));
+    }
+    bool indirect = commandData.ptr && instanceData.ptr;
+    glState.bindVertexArray(chunkVAO);
+    glState.bindBuffer(GL_ARRAY_BUFFER, chunkMeshes.buffer()); // The pool's buffer changes when it grows
+    glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(ChunkVertex), (void*)0);
+    if (indirect) {
+        std::copy(ordered.begin(), ordered.end(), static_cast<DrawElementsIndirectCommand*>(commandData.ptr));
+        std::copy(draws.instances.begin(), draws.instances.end(), static_cast<ChunkInstance*>(instanceData.ptr));
+        frameStream.commit();
+
+        // baseInstance picks each command's instance out of the divisor-1 attributes
+        glState.bindBuffer(GL_ARRAY_BUFFER, frameStream.buffer());
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(ChunkInstance), (void*)(instanceData.offset + offsetof(ChunkInstance, origin)));
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ChunkInstance), (void*)(instanceData.offset + offsetof(ChunkInstance, outline)));
+        glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, frameStream.buffer());
+    }
+
+    for (const Batch& batch : batches) {
+        DrawKey key = queue[batch.firstKey];
+        bool outline = RenderQueue::material(key) == DRAW_MATERIAL_OUTLINE;
+        glState.polygonMode(outline ? GL_LINE : GL_FILL);
+
+        if (RenderQueue::program(key) == DRAW_PROGRAM_TERRAIN) {
+            glState.useProgram(shaderProgram);
+            glUniform4f(colorLoc, 0.0f, 0.5f, 0.2f, 1.0f);
+            glState.bindVertexArray(terrainVAO);
+            for (size_t i = batch.firstKey; i < batch.endKey; ++i) {
+                const TerrainTile* tile = tiles[RenderQueue::item(queue[i]) - meshCount];
+                glDrawElements(GL_TRIANGLES, tile->indexCount, GL_UNSIGNED_INT, (void*)(tile->firstIndex * sizeof(GLuint)));
+            }
+            continue;
+        }
+
+        // Faces in the fill pass, wireframe edges in each chunk's colour in the outline pass
+        glState.useProgram(chunkProgram);
+        glUniform1i(chunkOutlineLoc, outline ? GL_TRUE : GL_FALSE);
+        glState.bindVertexArray(chunkVAO);
+        if (indirect) {
+            // Runs of unconditional meshes go in one indirect draw; each conditional mesh gets its own
+            GLuint command = batch.firstCommand, runStart = command;
+            for (size_t i = batch.firstKey; i <= batch.endKey; ++i) {
+                GLuint mesh = i < batch.endKey ? RenderQueue::item(queue[i]) : 0;
+                GLuint condition = i < batch.endKey ? draws.conditions[mesh] : 0;
+                if ((i == batch.endKey || condition) && command > runStart) {
+                    const void* offset = reinterpret_cast<const void*>(commandData.offset + runStart * sizeof(DrawElementsIndirectCommand));
+                    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, offset, static_cast<GLsizei>(command - runStart), 0);
+                    ++stats.chunkDrawCalls;
+                }
+                if (i == batch.endKey) {
+                    break;
+                }
+                GLuint commandCount = draws.firstCommands[mesh + 1] - draws.firstCommands[mesh];
+                if (condition) {
+                    // No wait: if the result isn't in yet the mesh is simply drawn
+                    const void* offset = reinterpret_cast<const void*>(commandData.offset + command * sizeof(DrawElementsIndirectCommand));
+                    glBeginConditionalRender(condition, GL_QUERY_NO_WAIT);
+                    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, offset, static_cast<GLsizei>(commandCount), 0);
+                    glEndConditionalRender();
+                    ++stats.chunkDrawCalls;
+                    runStart = command + commandCount;
+                }
+                command += commandCount;
+            }
+            continue;
+        }
+
+        // Below GL 4.3 (or with the stream region full): one multi-draw per mesh,
+        // with the per-draw data set as constant attributes
+        for (size_t i = batch.firstKey; i < batch.endKey; ++i) {
+            GLuint mesh = RenderQueue::item(queue[i]);
+            GLsizei counts[FACE_COUNT];
+            const void* offsets[FACE_COUNT];
+            GLint baseVertices[FACE_COUNT];
+            GLsizei ranges = 0;
+            for (GLuint command = draws.firstCommands[mesh]; command < draws.firstCommands[mesh + 1]; ++command, ++ranges) {
+                counts[ranges] = draws.commands[command].count;
+                offsets[ranges] = reinterpret_cast<const void*>(static_cast<uintptr_t>(draws.commands[command].firstIndex) * sizeof(GLushort));
+                baseVertices[ranges] = draws.commands[command].baseVertex;
+            }
+            const ChunkInstance& data = draws.instances[mesh];
+            glVertexAttrib4f(1, data.origin.x, data.origin.y, data.origin.z, data.origin.w);
+            glVertexAttrib4Nub(2, data.outline[0], data.outline[1], data.outline[2], data.outline[3]);
+            if (draws.conditions[mesh]) {
+                glBeginConditionalRender(draws.conditions[mesh], GL_QUERY_NO_WAIT);
+            }
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts, GL_UNSIGNED_SHORT, offsets, ranges, baseVertices);
+            if (draws.conditions[mesh]) {
+                glEndConditionalRender();
+            }
+            ++stats.chunkDrawCalls;
+        }
+    }
+
+    // Every batch sets its own polygon mode, so only the chunk VAO's instance attributes need resetting.
+    // The array buffer is unbound since the mesh pool deletes its buffer when it grows.
+    if (indirect) {
+        glState.bindVertexArray(chunkVAO);
+        glState.bindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glDisableVertexAttribArray(1);
+        glDisableVertexAttribArray(2);
+    }
+    glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Renderer::collectOverdraw() {
+    for (OverdrawQuery& query : overdrawQueries) {
+        if (!query.pending) {
+            continue;
+        }
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(query.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+        GLuint samples = 0;
+        glGetQueryObjectuiv(query.query, GL_QUERY_RESULT, &samples);
+        query.pending = false;
+        if (query.sorted) {
+            stats.sortedSamples += samples;
+            stats.sortedPixels += query.pixels;
+            ++stats.sortedFramesMeasured;
+        } else {
+            stats.unsortedSamples += samples;
+            stats.unsortedPixels += query.pixels;
+            ++stats.unsortedFramesMeasured;
+        }
+    }
+}
+
+void Renderer::cullBoxes(const glm::mat4& viewProjection, const glm::vec3& eye, FrameVector<Chunk*>& chunks,
+                         FrameVector<const TerrainTile*>& tiles, FrameVector<LodChunk*>& lods) {
+    frustum.update(viewProjection);
+    size_t candidates = chunks.size() + terrainTiles.size() + lods.size();
+    stats.cullTested += candidates;
+
+    // Frustum first; boxes of whatever survives are kept for the occlusion test
+    FrameVector<glm::vec3> boundsMin, boundsMax;
+    boundsMin.reserve(candidates);
+    boundsMax.reserve(candidates);
+    size_t kept = 0;
+    for (Chunk* chunk : chunks) {
+        glm::vec3 chunkMin, chunkMax;
+        if (!voxels.chunkBounds(chunk->coord, chunkMin, chunkMax)) {
+            chunkMin = glm::vec3(chunk->coord.first * CHUNK_SIZE, 0.0f, chunk->coord.second * CHUNK_SIZE) - glm::vec3(0.5f);
+            chunkMax = chunkMin + glm::vec3(CHUNK_SIZE);
+        }
+        if (frustum.intersects(chunkMin, chunkMax)) {
+            chunks[kept++] = chunk;
+            boundsMin.push_back(chunkMin);
+            boundsMax.push_back(chunkMax);
+        }
+    }
+    chunks.resize(kept);
+    FrameVector<unsigned char> tileVisible(terrainTiles.size());
+    size_t tilesInFrustum = 0;
+    for (size_t i = 0; i < terrainTiles.size(); ++i) {
+        tileVisible[i] = frustum.intersects(terrainTiles[i].boundsMin, terrainTiles[i].boundsMax);
+        tilesInFrustum += tileVisible[i];
+    }
+    FrameVector<unsigned char> lodVisible(lods.size());
+    size_t lodsInFrustum = 0;
+    for (size_t i = 0; i < lods.size(); ++i) {
+        lodVisible[i] = frustum.intersects(lods[i]->boundsMin, lods[i]->boundsMax);
+        lodsInFrustum += lodVisible[i];
+    }
+    stats.culledOutsideFrustum += candidates - chunks.size() - tilesInFrustum - lodsInFrustum;
+
+    // Far terrain behind nearer ridges is cheap to find on a heightfield
+    if (config.horizonCulling && horizonCuller.tileCount() == terrainTiles.size()) {
+        stats.culledBelowHorizon += horizonCuller.cull(eye, tileVisible.data());
+    }
+    tiles.reserve(tilesInFrustum);
+    for (size_t i = 0; i < terrainTiles.size(); ++i) {
+        if (tileVisible[i]) {
+            tiles.push_back(&terrainTiles[i]);
+            boundsMin.push_back(terrainTiles[i].boundsMin);
+            boundsMax.push_back(terrainTiles[i].boundsMax);
+        }
+    }
+    kept = 0;
+    for (size_t i = 0; i < lods.size(); ++i) {
+        if (lodVisible[i]) {
+            lods[kept++] = lods[i];
+            boundsMin.push_back(lods[i]->boundsMin);
+            boundsMax.push_back(lods[i]->boundsMax);
+        }
+    }
+    lods.resize(kept);
+    if (!config.occlusionCulling || boundsMin.empty()) {
+        return;
+    }
+
+    // Occluders: a coarse terrain under the real one, and the solid bottom layers of chunks
+    occlusionCuller.beginFrame(viewProjection);
+    for (const TerrainTile* tile : tiles) {
+        for (size_t i = 0; i < tile->occluder.size(); i += 3) {
+            occlusionCuller.addTriangle(tile->occluder[i], tile->occluder[i + 1], tile->occluder[i + 2]);
+        }
+    }
+    for (const Chunk* chunk : chunks) {
+        if (chunk->solidFloor > 0) {
+            glm::vec3 floorMin = glm::vec3(chunk->coord.first * CHUNK_SIZE, 0.0f, chunk->coord.second * CHUNK_SIZE) - glm::vec3(0.5f);
+            occlusionCuller.addBox(floorMin, floorMin + glm::vec3(CHUNK_SIZE, chunk->solidFloor, CHUNK_SIZE));
+        }
+    }
+    occlusionCuller.rasterise(workers);
+
+    FrameVector<unsigned char> visible(boundsMin.size());
+    occlusionCuller.testBoxes(boundsMin.data(), boundsMax.data(), static_cast<int>(boundsMin.size()), visible.data(), workers);
+    stats.culledOccluded += occlusionCuller.stats().occluded;
+
+    // Chunk boxes come first, then the tiles, then the LOD cells
+    kept = 0;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        if (visible[i]) {
+            chunks[kept++] = chunks[i];
+        }
+    }
+    size_t chunkBoxes = chunks.size();
+    chunks.resize(kept);
+    kept = 0;
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        if (visible[chunkBoxes + i]) {
+            tiles[kept++] = tiles[i];
+        }
+    }
+    size_t tileBoxes = tiles.size();
+    tiles.resize(kept);
+    kept = 0;
+    for (size_t i = 0; i < lods.size(); ++i) {
+        if (visible[chunkBoxes + tileBoxes + i]) {
+            lods[kept++] = lods[i];
+        }
+    }
+    lods.resize(kept);
+}
+
+void Renderer::updateSelection(Camera& camera) {
+    VoxelRayHit hit;
+    camera.hasSelection = voxels.raycast(camera.Position, camera.Front, config.pickDistance, hit);
+    if (camera.hasSelection) {
+        camera.currentSelected = glm::vec3(hit.voxel);
+        camera.selectedFace = glm::vec3(hit.normal);
+    }
+}
+
+int Renderer::pick(const VoxelRay* rays, int count, VoxelRayHit* hits) {
+    // Casts are a microsecond or so each, so hand them out in blocks
+    const int blockSize = 256;
+    std::atomic<int> found{0};
+    workers.parallelFor((count + blockSize - 1) / blockSize, [&](int block) {
+        int first = block * blockSize;
+        found += voxels.raycast(rays + first, std::min(blockSize, count - first), hits + first);
+    });
+    return found;
+}
+
+bool Renderer::requestChunk(const ChunkCoord& coord, bool prefetch) {
+    if (chunkResidency.contains(coord) || voxelising.contains(coord)) {
+        return false;
+    }
+    voxelising[coord] = 1;
+    if (!prefetch) {
+        ++prefetcher.stats.demandBuilds;
+    }
+
+    // Voxelise on a worker; the heightfield is read-only once loaded
+    workers.submit([this, coord, prefetch]() {
+        Chunk chunk;
+        chunk.coord = coord;
+        chunk.prefetched = prefetch;
+        ChunkColumns columns;
+        buildColumns(heightField, coord, columns);
+        columnsToVoxels(columns, chunk.voxels);
+        chunk.solidFloor = solidFloor(columns);
+
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        finishedChunks.push_back(std::move(chunk));
+    });
+    return true;
+}
+
+void Renderer::collectChunks() {
+    std::lock_guard<std::mutex> lock(finishedMutex);
+    for (Chunk& chunk : finishedChunks) {
+        voxelising.erase(chunk.coord);
+        voxels.update(chunk.coord, chunk.voxels);
+        ChunkCoord coord = chunk.coord;
+        bool outside = !chunk.prefetched && !chunkGrid.contains(coord);
+        chunkResidency.insert(std::move(chunk), frameIndex);
+        if (outside) {
+            chunkResidency.release(coord); // The window moved on while it was being voxelised
+        }
+
+        // Neighbours meshed without this chunk have open borders and wrong AO along it
         for (int dz = -1; dz <= 1; ++dz) {
-            visitedChunks.insert(std::make_pair(chunk.first + dx, chunk.second + dz));
+            for (int dx = -1; dx <= 1; ++dx) {
+                Chunk* neighbour = chunkResidency.peek(std::make_pair(coord.first + dx, coord.second + dz));
+                if (neighbour && neighbour->meshed && !(neighbour->meshedNeighbours & (1 << neighbourIndex(-dx, -dz)))) {
+                    neighbour->stale = true;
+                }
+            }
+        }
+    }
+    finishedChunks.clear();
+
+    for (LodChunk& lod : finishedLods) {
+        lodVoxelising[lod.cell.level - 1].erase(lod.cell.cell);
+        chunkResidency.insertLod(std::move(lod), frameIndex);
+    }
+    finishedLods.clear();
+}
+
+void Renderer::buildChunkMesh(Chunk& chunk) {
+    // Upload the packed faces once; they're reused for as long as the chunk is resident
+    // Faces and AO along the borders depend on whichever neighbours are loaded
+    ChunkNeighbours neighbours;
+    unsigned short present = 0;
+    for (int dz = -1; dz <= 1; ++dz) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            const Chunk* neighbour = chunkResidency.peek(std::make_pair(chunk.coord.first + dx, chunk.coord.second + dz));
+            if ((dx != 0 || dz != 0) && neighbour) {
+                neighbours.voxels[neighbourIndex(dx, dz)] = &neighbour->voxels;
+                present |= 1 << neighbourIndex(dx, dz);
+            }
+        }
+    }
+
+    FrameVector<ChunkVertex> vertices;
+    vertices.reserve(MAX_CHUNK_FACES * 4);
+    meshChunk(chunk.voxels, neighbours, vertices, chunk.faceRanges);
+
+    bool uploaded = chunkResidency.setMesh(chunk, vertices.data(), static_cast<GLsizei>(vertices.size()));
+    chunk.meshed = true;
+    chunk.meshedNeighbours = present;
+    chunk.connectivity = faceConnectivity(chunk.voxels);
+    chunk.faceCount = uploaded ? static_cast<GLsizei>(vertices.size() / 4) : 0;
+}
+
+bool Renderer::requestLod(const LodCell& cell) {
+    if (lodVoxelising[cell.level - 1].contains(cell.cell)) {
+        return false;
+    }
+    lodVoxelising[cell.level - 1][cell.cell] = 1;
+
+    workers.submit([this, cell]() {
+        LodChunk lod;
+        lod.cell = cell;
+        int layers = buildLodVoxels(heightField, cell, lod.voxels);
+        lod.boundsMin = lod.origin();
+        lod.boundsMax = lod.boundsMin + glm::vec3(CHUNK_SIZE, layers, CHUNK_SIZE) * lod.scale();
+
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        finishedLods.push_back(std::move(lod));
+    });
+    return true;
+}
+
+void Renderer::buildLodMesh(LodChunk& lod) {
+    // Cells are meshed without neighbours, so every border gets walls down to the
+    // floor. These skirts hide the cracks where the next level meets a different
+    // surface height, and between cells of one level they sit inside the terrain.
+    FrameVector<ChunkVertex> vertices;
+    vertices.reserve(MAX_CHUNK_FACES * 4);
+    meshChunk(lod.voxels, ChunkNeighbours(), vertices, lod.faceRanges);
+
+    bool uploaded = chunkResidency.setLodMesh(lod, vertices.data(), static_cast<GLsizei>(vertices.size()));
+    lod.meshed = true;
+    lod.faceCount = uploaded ? static_cast<GLsizei>(vertices.size() / 4) : 0;
+    ++stats.lodCellsBuilt;
+}
+
+void Renderer::updateVisitedChunks(const std::pair<int, int>& chunk) {
+    chunkGrid.recenter(chunk);
+
+    // Chunks that left stay resident in case the camera turns back, but go first under memory pressure
+    for (const ChunkCoord& coord : chunkGrid.left()) {
+        chunkResidency.release(coord);
+    }
+
+    // Chunks still resident from an earlier visit come back for free; the rest get voxelised.
+    // With LOD on, chunks under a LOD cell are left alone; render() requests the ones that
+    // become full resolution as the window moves.
+    for (const ChunkCoord& coord : chunkGrid.entered()) {
+        if (config.lodLevels > 0 && !isFullResolution(chunkGrid.getCentre(), chunkGrid.getRadius(), coord)) {
+            continue;
+        }
+        if (!chunkResidency.acquire(coord, frameIndex)) {
+            requestChunk(coord, false);
         }
     }
 }
@@ -219,77 +998,66 @@ std::pair<int, int> Renderer::getCurrentChunk(float cameraX, float cameraZ) {
 
 void Renderer::cleanup() {
     // Good practice to clean up :)
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteBuffers(1, &cubeVBO);
+    glDeleteVertexArrays(1, &chunkVAO);
+    glDeleteBuffers(1, &quadIndexEBO);
     glDeleteVertexArrays(1, &terrainVAO);
     glDeleteBuffers(1, &terrainVBO);
-    glDeleteProgram(shaderProgram);
-}
-
-unsigned int Renderer::loadShaders(const char* vertexPath, const char* fragmentPath) {
-    // Helper function so we can load shaders more neatly
-    std::string vertexCode, fragmentCode;
-    std::ifstream vShaderFile, fShaderFile;
-
-    vShaderFile.open(vertexPath);
-    fShaderFile.open(fragmentPath);
-
-    std::stringstream vShaderStream, fShaderStream;
-    vShaderStream << vShaderFile.rdbuf();
-    fShaderStream << fShaderFile.rdbuf();
-
-    vertexCode = vShaderStream.str();
-    fragmentCode = fShaderStream.str();
-
-    vShaderFile.close();
-    fShaderFile.close();
-
-    const char* vShaderCode = vertexCode.c_str();
-    const char* fShaderCode = fragmentCode.c_str();
-
-    unsigned int vertex, fragment;
-    int success;
-    char infoLog[512];
-
-    // Vertex shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
-    glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-        return 0;
-    }
-
-    // Fragment shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
-    glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-        return 0;
-    }
-
-    // Shader program
-    unsigned int program = glCreateProgram();
-    glAttachShader(program, vertex);
-    glAttachShader(program, fragment);
-    glLinkProgram(program);
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(program, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-        return 0;
-    }
-
-    // Cleaning up the shaders since they're already linked
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
-
-    return program;
+    glDeleteBuffers(1, &terrainEBO);
+    gpuOcclusion.destroy();
+    for (OverdrawQuery& query : overdrawQueries) {
+        glDeleteQueries(1, &query.query);
+    }
+    const ResidencyStats& residency = chunkResidency.stats();
+    std::cout << "Chunk residency: " << residency.hits << " hits, " << residency.misses << " misses, "
+              << residency.evictions << " evictions, " << residency.lodEvictions << " LOD cells evicted" << std::endl;
+    const PrefetchStats& prefetch = prefetcher.stats;
+    unsigned long long firstDraws = prefetch.hits + prefetch.demandBuilds;
+    std::cout << "Chunk prefetch: " << prefetch.scheduled << " built ahead, hit rate "
+              << (firstDraws ? 100.0 * prefetch.hits / firstDraws : 0.0) << "%, "
+              << residency.wastedPrefetches << " wasted" << std::endl;
+    std::cout << "Frame arena: high water " << frameArena().highWater() / 1024 << " KB, " << frameArena().capacity() / 1024
+              << " KB reserved after growing " << frameArena().grows() << " times, " << stats.heapAllocatingFrames
+              << " of " << stats.frames << " frames allocated from the heap" << std::endl;
+    std::cout << "Face direction culling: " << stats.chunkFacesSubmitted << " of " << stats.chunkFaces << " chunk faces submitted ("
+              << (stats.chunkFaces ? 100.0 - 100.0 * stats.chunkFacesSubmitted / stats.chunkFaces : 0.0) << "% skipped)" << std::endl;
+    std::cout << "Culling: " << stats.culledUnreachable << " chunks unreachable, " << stats.cullTested << " boxes, " << (stats.cullTested ? 100.0 * stats.culledOutsideFrustum / stats.cullTested : 0.0)
+              << "% outside the frustum, " << (stats.cullTested ? 100.0 * stats.culledBelowHorizon / stats.cullTested : 0.0)
+              << "% below the horizon, " << (stats.cullTested ? 100.0 * stats.culledOccluded / stats.cullTested : 0.0) << "% occluded"
+              << std::endl;
+    const MeshPoolStats& pool = chunkMeshes.stats();
+    std::cout << "Chunk mesh pool: " << pool.usedBytes / 1024 << " of " << pool.capacityBytes / 1024 << " KB in use, fragmentation "
+              << pool.fragmentation() * 100.0f << "%, " << pool.moves << " meshes (" << pool.movedBytes / 1024 << " KB) moved by compaction in "
+              << pool.compactMs << " ms, grown " << pool.grows << " times" << std::endl;
+    std::cout << "Chunk LOD: " << stats.lodCellsBuilt << " cells built, " << (stats.frames ? double(stats.meshDraws) / stats.frames : 0.0)
+              << " meshes (" << (stats.frames ? double(stats.lodDraws) / stats.frames : 0.0) << " LOD cells) and "
+              << (stats.frames ? double(stats.meshVertices) / stats.frames : 0.0) << " vertices per frame in "
+              << (stats.frames ? double(stats.chunkDrawCalls) / stats.frames : 0.0) << " draw calls" << std::endl;
+    std::cout << "Draw order: " << (stats.frames ? double(stats.drawStateChanges) / stats.frames : 0.0) << " state changes per frame ("
+              << (stats.frames ? double(stats.unsortedStateChanges) / stats.frames : 0.0) << " in gather order), overdraw "
+              << stats.sortedOverdraw() << " sorted over " << stats.sortedFramesMeasured << " frames, " << stats.unsortedOverdraw()
+              << " unsorted over " << stats.unsortedFramesMeasured << " frames" << std::endl;
+    if (config.occlusionQueries != OCCLUSION_QUERIES_OFF) {
+        const OcclusionQueryStats& queries = gpuOcclusion.stats();
+        std::cout << "GPU occlusion queries: " << queries.issued << " issued, " << queries.resultsRead << " read back ("
+                  << queries.resultsPending << " checks found no result yet), " << queries.hidden << " chunk draws skipped, "
+                  << queries.conditional << " drawn conditionally, " << stats.culledOccluded << " boxes culled on the CPU" << std::endl;
+    }
+    const GLStateStats& state = glState.stats();
+    unsigned long long stateCalls = state.issued + state.filtered;
+    std::cout << "GL state cache: " << state.issued << " calls issued, " << state.filtered << " filtered ("
+              << (stateCalls ? 100.0 * state.filtered / stateCalls : 0.0) << "%)";
+    if (config.validateGLState) {
+        std::cout << ", " << state.mismatches << " mismatches";
+    }
+    std::cout << std::endl;
+    workers.stop();
+    chunkResidency.clear();
+    chunkMeshes.destroy();
+    voxels.clear();
+    terrain.clear();
+    shaderWatcher.stop();
+    shaderCache.cleanup();
+    frameStream.destroy();
 }
 
 std::vector<float> Renderer::loadHeightMap(const std::string& filePath, int& width, int& height) {
@@ -320,7 +1088,7 @@ std::vector<float> Renderer::generateTerrainVertices(const std::vector<float>& h
     std::vector<float> vertices;
     for (int z = 0; z < height; ++z) {
         for (int x = 0; x < width; ++x) {
-            float y = heightMap[z * width + x];
+            float y = heightMap[z * width + x] * heightField.heightScale;
             vertices.push_back(x);
             vertices.push_back(y);
             vertices.push_back(z);
@@ -1,10 +1,90 @@
 #pragma once
-#include <set>
 #include <vector>
 #include <string>
+#include "streambuffer.h"
+#include "shadercache.h"
+#include "shaderwatcher.h"
+#include "chunk.h"
+#include "chunkmesher.h"
+#include "chunklod.h"
+#include "meshpool.h"
+#include "framearena.h"
+#include "glstate.h"
+#include "renderqueue.h"
+#include "chunkgrid.h"
+#include "chunkresidency.h"
+#include "prefetcher.h"
+#include "voxeliser.h"
+#include "voxeltree.h"
+#include "terrainbvh.h"
+#include "frustum.h"
+#include "chunkvisibility.h"
+#include "occlusionculler.h"
+#include "occlusionqueries.h"
+#include "horizonculler.h"
+#include "workerpool.h"
+#include "camera.h"
+#include <mutex>
+
+// Tunables for the renderer, set before initialise()
+struct RendererConfig {
+    bool shaderHotReload = true;
+    double shaderReloadBudgetMs = 2.0; // Most time a frame may spend on shader rebuilds
+    int viewRadius = MIN_VIEW_RADIUS;          // Chunks drawn in each direction around the camera chunk
+    int chunkBuildsPerFrame = 8;               // Most chunk meshes built per frame
+    unsigned int workerThreads = 0;            // Threads voxelising chunks, 0 for one per core
+    float terrainHeightScale = CHUNK_SIZE - 1; // Heightmap value 1.0 in world units, at most CHUNK_SIZE - 1
+    size_t chunkCpuBudget = 256 * 1024 * 1024; // Bytes of chunk and LOD cell data kept in memory
+    size_t chunkGpuBudget = 256 * 1024 * 1024; // Bytes of chunk and LOD cell meshes kept in video memory
+    float prefetchLookaheadSeconds = 2.0f; // How far ahead the camera's path is predicted
+    int prefetchBuildsPerFrame = 2;        // Most chunks built ahead of time per frame
+    size_t frameArenaBytes = 1024 * 1024;  // Starting size of the render thread's frame arena
+    float pickDistance = 256.0f;           // How far the crosshair ray reaches
+    bool connectivityCulling = true;       // Skip chunks sealed off from the camera by solid rock
+    bool horizonCulling = true;            // Skip terrain tiles below the horizon of nearer terrain
+    bool occlusionCulling = true;          // Skip chunks and terrain tiles hidden behind hills
+    int occluderTerrainStep = 8;           // Heightmap cells per edge of a terrain occluder cell
+    int lodLevels = MAX_LOD_LEVELS;        // Downsampled levels drawn past viewRadius, 0 for chunks only
+    int lodViewRadius = 64;                // Chunks drawn in each direction, counting those in LOD cells
+    int lodBuildsPerFrame = 4;             // Most LOD cells requested and meshed per frame
+    float meshCompactThreshold = 0.25f;    // Chunk vertex buffer fragmentation above which meshes are moved together
+    size_t meshCompactBytesPerFrame = 1024 * 1024; // Most mesh data moved per frame while compacting
+    bool sortDraws = true;                 // Group draws by state and draw each group front to back
+    bool compareDrawOrder = false;         // Alternate sorted and unsorted frames to measure overdraw both ways
+    OcclusionQueryMode occlusionQueries = OCCLUSION_QUERIES_OFF; // Also test chunks with GPU occlusion queries
+    bool validateGLState = false;          // Check the GL state cache against glGet* (slow, stalls the pipeline)
+};
+
+struct RenderStats {
+    unsigned long long frames = 0;
+    unsigned long long heapAllocatingFrames = 0;     // Frames where render() called operator new
+    unsigned long long lastFrameHeapAllocations = 0;
+    unsigned long long chunkFaces = 0;          // Faces of the chunks drawn
+    unsigned long long chunkFacesSubmitted = 0; // Of those, in a direction that could face the camera
+    unsigned long long culledUnreachable = 0;  // Chunks the connectivity search never reached
+    unsigned long long cullTested = 0;         // Chunk and terrain tile boxes considered for drawing
+    unsigned long long culledOutsideFrustum = 0;
+    unsigned long long culledBelowHorizon = 0;
+    unsigned long long culledOccluded = 0;
+    unsigned long long meshDraws = 0;    // Chunk and LOD cell meshes drawn
+    unsigned long long meshVertices = 0; // Vertices of the faces submitted for them
+    unsigned long long lodDraws = 0;     // Of the draws, LOD cells standing in for far chunks
+    unsigned long long chunkDrawCalls = 0; // GL draw calls those meshes took
+    unsigned long long lodCellsBuilt = 0;
+    unsigned long long drawStateChanges = 0;     // Program, pass or material switches while drawing
+    unsigned long long unsortedStateChanges = 0; // Switches the same draws would have taken in gather order
+    // Samples that passed the depth test and pixels covered, summed over measured frames
+    unsigned long long sortedSamples = 0, sortedPixels = 0, sortedFramesMeasured = 0;
+    unsigned long long unsortedSamples = 0, unsortedPixels = 0, unsortedFramesMeasured = 0;
+    // Samples written per pixel: 1 means no fragment was shaded and then hidden
+    double sortedOverdraw() const { return sortedPixels ? static_cast<double>(sortedSamples) / sortedPixels : 0.0; }
+    double unsortedOverdraw() const { return unsortedPixels ? static_cast<double>(unsortedSamples) / unsortedPixels : 0.0; }
+};
 
 class Renderer {
 public:
+    RendererConfig config;
+
     void initialise();
     void render();
     void cleanup();
@@ -12,10 +92,136 @@ public:
     std::vector<float> generateTerrainVertices(const std::vector<float>& heightMap, int width, int height);
     void updateVisitedChunks(const std::pair<int, int>& chunk);
     std::pair<int, int> getCurrentChunk(float cameraX, float cameraZ);
-    unsigned int loadShaders(const char* vertexPath, const char* fragmentPath);
+    const ResidencyStats& residencyStats() const { return chunkResidency.stats(); }
+    const PrefetchStats& prefetchStats() const { return prefetcher.stats; }
+    // Solid voxels of the resident chunks, for ray casts and overlap tests
+    const VoxelTree& voxelTree() const { return voxels; }
+    // Triangles of the heightmap terrain, for ray and line of sight queries
+    const TerrainBVH& terrainBVH() const { return terrain; }
+    // Casts the camera's view ray and stores what it hits in the camera's selection
+    void updateSelection(Camera& camera);
+    // Casts many rays at once, spread over the worker threads; returns how many hit
+    int pick(const VoxelRay* rays, int count, VoxelRayHit* hits);
+    const RenderStats& renderStats() const { return stats; }
+    // Occluders and boxes tested in the last frame
+    const OcclusionStats& occlusionStats() const { return occlusionCuller.stats(); }
+    const HorizonStats& horizonStats() const { return horizonCuller.stats(); }
+    // Space, fragmentation and compaction of the shared chunk vertex buffer
+    const MeshPoolStats& meshPoolStats() const { return chunkMeshes.stats(); }
+    // GL calls issued and filtered as redundant by the state cache
+    const GLStateStats& glStateStats() const { return glState.stats(); }
+    const OcclusionQueryStats& occlusionQueryStats() const { return gpuOcclusion.stats(); }
 
 private:
-    unsigned int cubeVBO, cubeVAO, terrainVBO, terrainVAO, shaderProgram;
+    unsigned int chunkVAO, quadIndexEBO, terrainVBO, terrainEBO, terrainVAO, shaderProgram;
     std::vector<float> terrainVertices; // Add this line
-    std::set<std::pair<int, int>> visitedChunks;
+    TerrainBVH terrain;
+
+    // The terrain is indexed tile by tile so each tile can be culled on its own
+    struct TerrainTile {
+        GLsizei firstIndex = 0, indexCount = 0;
+        glm::vec3 boundsMin, boundsMax;
+        std::vector<glm::vec3> occluder; // Coarse triangles lying on or under the tile's surface
+    };
+    std::vector<TerrainTile> terrainTiles;
+    void buildTerrainTiles(int width, int height);
+
+    // Hills hide most of the view, so boxes are tested against a CPU depth buffer before drawing
+    Frustum frustum;
+    HorizonCuller horizonCuller;
+    OcclusionCuller occlusionCuller;
+    // Drops chunks, tiles and LOD cells outside the frustum, below the horizon (tiles only)
+    // or hidden behind occluders
+    void cullBoxes(const glm::mat4& viewProjection, const glm::vec3& eye, FrameVector<Chunk*>& chunks,
+                   FrameVector<const TerrainTile*>& tiles, FrameVector<LodChunk*>& lods);
+    // Chunk boxes drawn against the depth buffer after each frame, for the next frame to use
+    OcclusionQueries gpuOcclusion;
+
+    // Which chunks exist: the window around the camera chunk
+    ChunkGrid chunkGrid;
+
+    // Chunks are voxelised from the heightmap on worker threads and handed back through finishedChunks
+    HeightField heightField;
+    WorkerPool workers;
+    ChunkMap<unsigned char> voxelising; // Non-zero while a worker has the chunk
+    std::vector<Chunk> finishedChunks;
+    std::mutex finishedMutex;
+    bool requestChunk(const ChunkCoord& coord, bool prefetch);
+    void collectChunks();
+
+    // Built chunks stay resident after leaving view, within the configured budgets
+    ChunkResidency chunkResidency;
+    unsigned long long frameIndex = 0;
+    ChunkPrefetcher prefetcher;
+    void buildChunkMesh(Chunk& chunk);
+    VoxelTree voxels; // Mirrors the resident chunks
+    ChunkVisibility chunkVisibility;
+
+    // Past the full resolution chunks, squares of chunks are drawn as one downsampled mesh.
+    // Cells are voxelised on the workers straight from the heightmap and kept in
+    // chunkResidency, under the same budgets as chunks. Indexed by level - 1.
+    ChunkMap<unsigned char> lodVoxelising[MAX_LOD_LEVELS];
+    std::vector<LodChunk> finishedLods; // Guarded by finishedMutex
+    bool requestLod(const LodCell& cell);
+    void buildLodMesh(LodChunk& lod);
+
+    // Every chunk and LOD cell mesh lives in one TLSF-managed buffer so all of them draw with a single
+    // glMultiDrawElementsIndirect per pass (GL 4.3), or one multi-draw per mesh below that
+    MeshPool chunkMeshes;
+    bool multiDrawIndirect = false;
+    struct DrawElementsIndirectCommand {
+        GLuint count, instanceCount, firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+    struct ChunkInstance {
+        glm::vec4 origin;          // World position of corner (0, 0, 0); w is world units per voxel
+        unsigned char outline[4];  // Wireframe colour
+    };
+    // Commands for every mesh in the frame; mesh i owns commands [firstCommands[i], firstCommands[i + 1])
+    // and instance i, and is drawn under conditional rendering with query conditions[i] when that isn't 0
+    struct ChunkDrawList {
+        FrameVector<DrawElementsIndirectCommand> commands;
+        FrameVector<ChunkInstance> instances;
+        FrameVector<GLuint> firstCommands;
+        FrameVector<GLuint> conditions;
+    };
+    // Adds commands for the face directions of a mesh that can face the camera; false if none can
+    bool queueChunkMesh(const MeshPool::Allocation& mesh, GLsizei faceCount, const ChunkFaceRanges& faceRanges, const glm::vec3& boundsMin,
+                        const glm::vec3& boundsMax, const glm::vec3& origin, float scale, const ChunkCoord& coord, GLuint condition,
+                        ChunkDrawList& draws);
+    // Draws the queue in its order, one batch per run of keys with the same state
+    void submitDraws(const RenderQueue& queue, const ChunkDrawList& draws, const FrameVector<const TerrainTile*>& tiles);
+
+    // Samples passed over the whole submission, read back a few frames later to measure overdraw
+    static const int OVERDRAW_QUERIES = 4;
+    struct OverdrawQuery {
+        GLuint query = 0;
+        bool pending = false;
+        bool sorted = false;
+        unsigned long long pixels = 0;
+    };
+    OverdrawQuery overdrawQueries[OVERDRAW_QUERIES];
+    void collectOverdraw();
+
+    // Program, VAO, buffer and raster state set through here skip calls that change nothing
+    GLStateCache glState;
+
+    // Per-frame matrices are written straight into this buffer
+    StreamBuffer frameStream;
+    int uniformAlignment = 256;
+
+    // Programs are built asynchronously; shaderProgram and chunkProgram are 0 until ready
+    ShaderCache shaderCache;
+    ShaderCache::Handle mainShader = 0;
+    int colorLoc = -1;
+    ShaderCache::Handle chunkShader = 0;
+    GLuint chunkProgram = 0;
+    int chunkOutlineLoc = -1;
+    ShaderCache::Handle boxShader = 0;
+    GLuint boxProgram = 0;
+    int boxMinLoc = -1, boxMaxLoc = -1;
+    ShaderWatcher shaderWatcher;
+
+    RenderStats stats;
 };
\ No newline at end of file
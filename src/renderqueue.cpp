@@ -0,0 +1,57 @@
+#include "renderqueue.h"
+#include <algorithm>
+
+void RenderQueue::push(unsigned int pass, unsigned int program, unsigned int material, float depth, uint32_t item) {
+    const uint64_t depthMax = (1ull << DRAW_KEY_DEPTH_BITS) - 1;
+    uint64_t quantised = static_cast<uint64_t>(std::min(std::max(depth, 0.0f), 1.0f) * depthMax);
+    keys.push_back(static_cast<DrawKey>(pass & 3u) << 62 | static_cast<DrawKey>(program & 63u) << 56 |
+                   static_cast<DrawKey>(material & 255u) << 48 | quantised << DRAW_KEY_ITEM_BITS |
+                   (item & ((1u << DRAW_KEY_ITEM_BITS) - 1)));
+}
+
+void RenderQueue::sort() {
+    if (keys.size() < 2) {
+        return;
+    }
+
+    // Bytes where every key agrees don't change the order, so skip their passes.
+    // With a few hundred draws that's usually the pass, program and material bytes.
+    DrawKey same = ~0ull, first = keys[0];
+    for (DrawKey key : keys) {
+        same &= ~(key ^ first);
+    }
+
+    FrameVector<DrawKey> scratch(keys.size());
+    DrawKey* from = keys.data();
+    DrawKey* to = scratch.data();
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((same >> shift) & 0xFF) == 0xFF) {
+            continue;
+        }
+        size_t counts[256] = {};
+        for (size_t i = 0; i < keys.size(); ++i) {
+            ++counts[(from[i] >> shift) & 0xFF];
+        }
+        size_t offset = 0;
+        for (size_t& count : counts) {
+            size_t bucket = count;
+            count = offset;
+            offset += bucket;
+        }
+        for (size_t i = 0; i < keys.size(); ++i) {
+            to[counts[(from[i] >> shift) & 0xFF]++] = from[i];
+        }
+        std::swap(from, to);
+    }
+    if (from != keys.data()) {
+        std::copy(from, from + keys.size(), keys.data());
+    }
+}
+
+int RenderQueue::stateChanges() const {
+    int changes = 0;
+    for (size_t i = 1; i < keys.size(); ++i) {
+        changes += state(keys[i]) != state(keys[i - 1]);
+    }
+    return changes;
+}
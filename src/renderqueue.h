@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "framearena.h"
+
+// Sort key of one queued draw, most significant bits first:
+//   bits 62-63  pass
+//   bits 56-61  program
+//   bits 48-55  material (uniforms and raster state the draw needs)
+//   bits 24-47  distance from the camera, quantised, nearest first
+//   bits  0-23  the caller's item index, so keys are unique and carry their draw
+// Sorting the keys groups draws by state and puts each group front to back, so
+// early depth testing rejects most of what is hidden.
+typedef uint64_t DrawKey;
+
+#define DRAW_KEY_DEPTH_BITS 24
+#define DRAW_KEY_ITEM_BITS 24
+
+// Draws for one frame; lives in the frame arena
+class RenderQueue {
+public:
+    void reserve(size_t count) { keys.reserve(count); }
+    // depth is the distance to the draw's nearest point over the far plane distance, clamped to [0, 1]
+    void push(unsigned int pass, unsigned int program, unsigned int material, float depth, uint32_t item);
+    // LSD radix sort over the key bytes, skipping bytes every key shares
+    void sort();
+
+    size_t size() const { return keys.size(); }
+    DrawKey operator[](size_t i) const { return keys[i]; }
+    // Draws whose pass, program or material differs from the one before, in the current order
+    int stateChanges() const;
+
+    static uint32_t item(DrawKey key) { return static_cast<uint32_t>(key & ((1u << DRAW_KEY_ITEM_BITS) - 1)); }
+    static unsigned int pass(DrawKey key) { return static_cast<unsigned int>(key >> 62); }
+    static unsigned int program(DrawKey key) { return static_cast<unsigned int>(key >> 56) & 63u; }
+    static unsigned int material(DrawKey key) { return static_cast<unsigned int>(key >> 48) & 255u; }
+    // Pass, program and material together: draws with the same state can be batched
+    static unsigned int state(DrawKey key) { return static_cast<unsigned int>(key >> 48); }
+
+private:
+    FrameVector<DrawKey> keys;
+};
@@ -0,0 +1,333 @@
+#include "shadercache.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+namespace {
+
+const uint32_t BINARY_MAGIC = 0x31434853; // "SHC1"
+
+// Written in front of every cached program binary
+struct BinaryHeader {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t length;
+    float buildMs; // What building from source cost, so a cache hit can report the time saved
+};
+
+double nowMs() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// FNV-1a, good enough to key a handful of programs
+uint64_t hashString(const std::string& text, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string readFile(const std::string& path) {
+    std::ifstream file(path);
+    std::stringstream stream;
+    stream << file.rdbuf();
+    return stream.str();
+}
+
+std::string glString(GLenum name) {
+    const GLubyte* value = glGetString(name);
+    return value ? reinterpret_cast<const char*>(value) : "";
+}
+
+} // namespace
+
+void ShaderCache::initialise(const std::string& cacheDirectory) {
+    directory = cacheDirectory;
+    driver = glString(GL_VENDOR) + "|" + glString(GL_RENDERER) + "|" + glString(GL_VERSION);
+
+    // Some drivers expose the entry points but no binary formats at all
+    GLint formats = 0;
+    if (GLEW_ARB_get_program_binary || GLEW_VERSION_4_1) {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    }
+    binariesSupported = formats > 0;
+    if (binariesSupported) {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+    }
+
+    // Let the driver pick how many compiler threads to use
+    if (GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        parallelCompile = true;
+    } else if (GLEW_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        parallelCompile = true;
+    }
+
+    std::cout << "Shader cache: binaries " << (binariesSupported ? "enabled" : "unsupported")
+              << ", parallel compile " << (parallelCompile ? "enabled" : "unsupported") << std::endl;
+}
+
+void ShaderCache::cleanup() {
+    for (Entry& entry : entries) {
+        discardBuild(entry);
+        glDeleteProgram(entry.program);
+    }
+    entries.clear();
+}
+
+ShaderCache::Handle ShaderCache::request(const std::string& vertexPath, const std::string& fragmentPath) {
+    Entry entry;
+    entry.vertexPath = vertexPath;
+    entry.fragmentPath = fragmentPath;
+
+    std::string vertexCode = readFile(vertexPath);
+    std::string fragmentCode = readFile(fragmentPath);
+    entry.key = hashString(driver, hashString(fragmentCode, hashString(vertexCode)));
+
+    if (!loadBinary(entry)) {
+        entry.vertexCode = vertexCode;
+        entry.fragmentCode = fragmentCode;
+        entry.stage = Compile;
+        entry.startFrame = frame;
+        entry.compileMs = entry.linkMs = 0.0;
+        // With parallel compile neither compile nor link waits, so issue both now;
+        // otherwise poll() takes them a frame at a time
+        if (parallelCompile) {
+            advanceBuild(entry);
+            advanceBuild(entry);
+        }
+    }
+
+    entries.push_back(entry);
+    return static_cast<Handle>(entries.size() - 1);
+}
+
+void ShaderCache::sourceChanged(const std::string& path) {
+    for (Entry& entry : entries) {
+        if (entry.vertexPath != path && entry.fragmentPath != path) {
+            continue;
+        }
+
+        std::string vertexCode = readFile(entry.vertexPath);
+        std::string fragmentCode = readFile(entry.fragmentPath);
+        uint64_t key = hashString(driver, hashString(fragmentCode, hashString(vertexCode)));
+        if (key == entry.key && entry.stage == Idle) {
+            continue; // Touched but not edited
+        }
+
+        // A newer edit supersedes any build still in flight. Even the binary cache
+        // waits for poll() so the reload stays within its budget.
+        discardBuild(entry);
+        entry.key = key;
+        entry.reload = true;
+        entry.vertexCode = vertexCode;
+        entry.fragmentCode = fragmentCode;
+        entry.stage = binariesSupported ? Load : Compile;
+        entry.startFrame = frame;
+        entry.compileMs = entry.linkMs = 0.0;
+    }
+}
+
+void ShaderCache::poll(double budgetMs) {
+    ++frame;
+    double start = nowMs();
+    bool advanced = false;
+    for (Entry& entry : entries) {
+        while (entry.stage != Idle) {
+            BuildStage stage = entry.stage;
+            double stepStart = nowMs();
+            if (advanced && stepStart - start + stageMs[stage] > budgetMs) {
+                return; // Out of time this frame, carry on next frame
+            }
+            if (!advanceBuild(entry)) {
+                break; // Waiting on the driver
+            }
+            stageMs[stage] = nowMs() - stepStart;
+            advanced = true;
+        }
+    }
+}
+
+std::string ShaderCache::binaryPath(uint64_t key) const {
+    std::stringstream path;
+    path << directory << "/" << std::hex << key << ".bin";
+    return path.str();
+}
+
+bool ShaderCache::loadBinary(Entry& entry) {
+    if (!binariesSupported) {
+        return false;
+    }
+
+    double start = nowMs();
+    std::ifstream file(binaryPath(entry.key), std::ios::binary);
+    BinaryHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != BINARY_MAGIC) {
+        return false;
+    }
+    std::vector<char> binary(header.length);
+    if (!file.read(binary.data(), binary.size())) {
+        return false;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), header.length);
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        // Usually a driver update; fall back to building from source
+        glDeleteProgram(program);
+        return false;
+    }
+
+    glDeleteProgram(entry.program);
+    entry.program = program;
+    double loadMs = nowMs() - start;
+    std::cout << "Shader program " << entry.vertexPath << (entry.reload ? " reloaded" : " loaded") << " from binary cache in " << loadMs
+              << " ms (saved " << header.buildMs - loadMs << " ms)" << std::endl;
+    return true;
+}
+
+void ShaderCache::saveBinary(const Entry& entry, double buildMs) {
+    if (!binariesSupported) {
+        return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(entry.program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(entry.program, length, NULL, &format, binary.data());
+
+    BinaryHeader header = { BINARY_MAGIC, format, static_cast<uint32_t>(length), static_cast<float>(buildMs) };
+    std::ofstream file(binaryPath(entry.key), std::ios::binary);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(binary.data(), binary.size());
+}
+
+bool ShaderCache::advanceBuild(Entry& entry) {
+    // Without parallel compile every stage blocks in the driver, so give each its own frame
+    if (!parallelCompile && entry.stage != Load && entry.stage != Compile && frame == entry.stageFrame) {
+        return false;
+    }
+
+    switch (entry.stage) {
+    case Load:
+        if (loadBinary(entry)) {
+            discardBuild(entry);
+        } else {
+            entry.stage = Compile;
+        }
+        return true;
+    case Compile: {
+        double compileStart = nowMs();
+        const char* vShaderCode = entry.vertexCode.c_str();
+        const char* fShaderCode = entry.fragmentCode.c_str();
+
+        entry.pendingVertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(entry.pendingVertex, 1, &vShaderCode, NULL);
+        glCompileShader(entry.pendingVertex);
+
+        entry.pendingFragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(entry.pendingFragment, 1, &fShaderCode, NULL);
+        glCompileShader(entry.pendingFragment);
+
+        entry.compileMs += nowMs() - compileStart;
+        entry.stageFrame = frame;
+        entry.stage = Link;
+        return true;
+    }
+    case Link: {
+        double linkStart = nowMs();
+        entry.pendingProgram = glCreateProgram();
+        if (binariesSupported) {
+            glProgramParameteri(entry.pendingProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glAttachShader(entry.pendingProgram, entry.pendingVertex);
+        glAttachShader(entry.pendingProgram, entry.pendingFragment);
+        glLinkProgram(entry.pendingProgram);
+        entry.linkMs += nowMs() - linkStart;
+        entry.stageFrame = frame;
+        entry.stage = Finish;
+        return true;
+    }
+    case Finish: {
+        // Querying link status blocks until the build is done, so with the
+        // extension only ask once the driver reports completion
+        double finishStart = nowMs();
+        if (parallelCompile) {
+            GLint complete = GL_FALSE;
+            glGetProgramiv(entry.pendingProgram, GL_COMPLETION_STATUS_KHR, &complete);
+            if (!complete) {
+                entry.linkMs += nowMs() - finishStart;
+                return false;
+            }
+        }
+
+        bool linked = finishBuild(entry);
+        entry.linkMs += nowMs() - finishStart;
+        double buildMs = entry.compileMs + entry.linkMs;
+        if (linked) {
+            std::cout << "Shader program " << entry.vertexPath << (entry.reload ? " reloaded" : " built from source") << " in "
+                      << buildMs << " ms over " << frame - entry.startFrame + 1 << " frames (compile " << entry.compileMs
+                      << " ms, link " << entry.linkMs << " ms)" << std::endl;
+            saveBinary(entry, buildMs);
+        } else if (entry.reload) {
+            std::cerr << "Shader reload of " << entry.vertexPath << " failed, keeping the previous program." << std::endl;
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool ShaderCache::finishBuild(Entry& entry) {
+    int linked, success;
+    char infoLog[512];
+
+    glGetProgramiv(entry.pendingProgram, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        glGetShaderiv(entry.pendingVertex, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(entry.pendingVertex, 512, NULL, infoLog);
+            std::cerr << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+        }
+        glGetShaderiv(entry.pendingFragment, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(entry.pendingFragment, 512, NULL, infoLog);
+            std::cerr << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+        }
+        glGetProgramInfoLog(entry.pendingProgram, 512, NULL, infoLog);
+        std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    } else {
+        // Swap in the new program; the old one stays bound until this point
+        glDeleteProgram(entry.program);
+        entry.program = entry.pendingProgram;
+        entry.pendingProgram = 0;
+    }
+
+    // Cleaning up the shaders since they're already linked
+    discardBuild(entry);
+    return linked;
+}
+
+void ShaderCache::discardBuild(Entry& entry) {
+    glDeleteShader(entry.pendingVertex);
+    glDeleteShader(entry.pendingFragment);
+    glDeleteProgram(entry.pendingProgram);
+    entry.pendingProgram = entry.pendingVertex = entry.pendingFragment = 0;
+    entry.stage = Idle;
+    entry.vertexCode.clear();
+    entry.fragmentCode.clear();
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Builds shader programs without stalling the render loop. Linked programs are
+// stored on disk with glGetProgramBinary, keyed by a hash of the sources and the
+// driver strings, and reloaded with glProgramBinary on later runs. Programs that
+// must be built from source are compiled in the background where the driver
+// supports GL_KHR_parallel_shader_compile and picked up by poll(). Without it,
+// compile, link and the link status check each get a frame of their own. Reloads
+// after a source edit replace the program only once the new one links successfully.
+class ShaderCache {
+public:
+    typedef int Handle;
+
+    void initialise(const std::string& cacheDirectory);
+    void cleanup();
+
+    // Starts loading a program; program() returns 0 until it's ready
+    Handle request(const std::string& vertexPath, const std::string& fragmentPath);
+    // Rebuilds every program that uses the given source file
+    void sourceChanged(const std::string& path);
+    // Advances builds in flight, starting no step expected to take it past budgetMs
+    // (apart from the frame's first, so builds always progress). Call once per
+    // frame, at the frame boundary.
+    void poll(double budgetMs);
+    GLuint program(Handle handle) const { return entries[handle].program; }
+
+private:
+    // Builds advance one stage at a time so a reload can be spread over frames.
+    // Reloads start by trying the binary cache.
+    enum BuildStage { Idle, Load, Compile, Link, Finish, StageCount };
+
+    struct Entry {
+        std::string vertexPath, fragmentPath;
+        GLuint program = 0;
+        uint64_t key = 0;
+
+        // Build in flight
+        BuildStage stage = Idle;
+        bool reload = false;
+        std::string vertexCode, fragmentCode;
+        GLuint pendingProgram = 0, pendingVertex = 0, pendingFragment = 0;
+        double compileMs = 0.0, linkMs = 0.0; // Time spent inside GL calls, not waiting between frames
+        unsigned int startFrame = 0, stageFrame = 0;
+    };
+
+    bool loadBinary(Entry& entry);
+    void saveBinary(const Entry& entry, double buildMs);
+    bool advanceBuild(Entry& entry);
+    bool finishBuild(Entry& entry);
+    void discardBuild(Entry& entry);
+    std::string binaryPath(uint64_t key) const;
+
+    std::vector<Entry> entries;
+    double stageMs[StageCount] = {}; // What each stage took last time it ran, to predict the next
+    unsigned int frame = 0;
+    std::string directory;
+    std::string driver; // Vendor, renderer and version; part of every cache key
+    bool binariesSupported = false;
+    bool parallelCompile = false;
+};
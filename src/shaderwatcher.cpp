@@ -0,0 +1,116 @@
+#include "shaderwatcher.h"
+#include <algorithm>
+#include <iostream>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+bool ShaderWatcher::start(const std::string& watchDirectory) {
+    directory = watchDirectory;
+#ifdef __linux__
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        std::cerr << "Failed to initialise inotify, shader hot reload disabled." << std::endl;
+        return false;
+    }
+    // Editors either rewrite the file in place or write a temporary and rename it over
+    watchFd = inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watchFd < 0) {
+        std::cerr << "Failed to watch " << directory << ", shader hot reload disabled." << std::endl;
+        stop();
+        return false;
+    }
+#else
+    std::error_code error;
+    for (const auto& file : std::filesystem::directory_iterator(directory, error)) {
+        modified[file.path().filename().string()] = file.last_write_time(error);
+    }
+    stopping = false;
+    scanner = std::thread(&ShaderWatcher::scanLoop, this);
+#endif
+    std::cout << "Watching " << directory << " for shader changes." << std::endl;
+    return true;
+}
+
+void ShaderWatcher::stop() {
+#ifdef __linux__
+    if (inotifyFd >= 0) {
+        close(inotifyFd); // Also removes the watch
+    }
+    inotifyFd = watchFd = -1;
+#else
+    if (scanner.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        scanner.join();
+    }
+    modified.clear();
+    detected.clear();
+    pending = false;
+#endif
+}
+
+#ifndef __linux__
+void ShaderWatcher::scanLoop() {
+    // No inotify here; a directory scan a few times a second is cheap enough, and
+    // doing it here keeps its allocations and file system calls off the render thread
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!wake.wait_for(lock, std::chrono::milliseconds(250), [this] { return stopping; })) {
+        lock.unlock();
+        std::vector<std::string> found;
+        std::error_code error;
+        for (const auto& file : std::filesystem::directory_iterator(directory, error)) {
+            auto writeTime = file.last_write_time(error);
+            auto& previous = modified[file.path().filename().string()];
+            if (previous != writeTime) {
+                previous = writeTime;
+                found.push_back(directory + "/" + file.path().filename().string());
+            }
+        }
+        lock.lock();
+        if (!found.empty()) {
+            detected.insert(detected.end(), found.begin(), found.end());
+            pending = true;
+        }
+    }
+}
+#endif
+
+const std::vector<std::string>& ShaderWatcher::poll() {
+    changed.clear();
+#ifdef __linux__
+    if (inotifyFd < 0) {
+        return changed;
+    }
+
+    alignas(inotify_event) char buffer[4096];
+    ssize_t length;
+    while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+        for (char* ptr = buffer; ptr < buffer + length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(ptr);
+            if (event->len > 0) {
+                changed.push_back(directory + "/" + event->name);
+            }
+            ptr += sizeof(inotify_event) + event->len;
+        }
+    }
+#else
+    if (!pending) {
+        return changed;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        changed.swap(detected);
+        pending = false;
+    }
+#endif
+
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+    return changed;
+}
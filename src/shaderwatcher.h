@@ -0,0 +1,44 @@
+#pragma once
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+#ifndef __linux__
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+// Watches the shader directory for edits so programs can be rebuilt while the
+// app is running. Uses inotify on Linux and falls back to polling modification
+// times on a thread of its own elsewhere. poll() never blocks, and doesn't
+// touch the heap unless a file changed.
+class ShaderWatcher {
+public:
+    bool start(const std::string& directory);
+    void stop();
+
+    // Paths (directory/name) of files written since the last call, without
+    // duplicates. Valid until the next call.
+    const std::vector<std::string>& poll();
+
+private:
+    std::string directory;
+    std::vector<std::string> changed; // Kept between calls to reuse its storage
+#ifdef __linux__
+    int inotifyFd = -1;
+    int watchFd = -1;
+#else
+    void scanLoop();
+
+    std::map<std::string, std::filesystem::file_time_type> modified; // Only used by the scan thread
+    std::thread scanner;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::vector<std::string> detected;  // Found by the scan thread, guarded by mutex
+    std::atomic<bool> pending{ false }; // Whether detected has anything, so poll() can skip the lock
+#endif
+};
@@ -0,0 +1,123 @@
+#include "streambuffer.h"
+#include <iostream>
+
+bool StreamBuffer::create(GLsizeiptr bytesPerFrame) {
+    regionSize = bytesPerFrame;
+    head = committed = 0;
+    region = 0;
+
+    glGenBuffers(1, &bufferID);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+
+    // Prefer immutable storage mapped once for the lifetime of the buffer
+    persistent = GLEW_ARB_buffer_storage || GLEW_VERSION_4_4;
+    if (persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, regionSize * FRAME_REGIONS, NULL, flags);
+        mapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, regionSize * FRAME_REGIONS, flags));
+        if (!mapped) {
+            std::cerr << "Failed to persistently map stream buffer, falling back to orphaning." << std::endl;
+            glDeleteBuffers(1, &bufferID);
+            glGenBuffers(1, &bufferID);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+            persistent = false;
+        }
+    }
+
+    // Fallback: a single region re-specified (orphaned) every frame
+    if (!persistent) {
+        glBufferData(GL_COPY_WRITE_BUFFER, regionSize, NULL, GL_STREAM_DRAW);
+        staging.resize(regionSize);
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    std::cout << "Stream buffer: " << (persistent ? "persistent mapping" : "orphaning") << ", "
+              << regionSize / 1024 << " KB per frame" << std::endl;
+    return true;
+}
+
+void StreamBuffer::destroy() {
+    for (GLsync& fence : fences) {
+        if (fence) {
+            glDeleteSync(fence);
+            fence = 0;
+        }
+    }
+    if (bufferID) {
+        if (mapped) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            mapped = nullptr;
+        }
+        glDeleteBuffers(1, &bufferID);
+        bufferID = 0;
+    }
+    staging.clear();
+}
+
+void StreamBuffer::beginFrame() {
+    head = committed = 0;
+
+    if (!persistent) {
+        // Orphan the old storage so the driver can hand us fresh memory without waiting
+        glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+        glBufferData(GL_COPY_WRITE_BUFFER, regionSize, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return;
+    }
+
+    region = (region + 1) % FRAME_REGIONS;
+    GLsync& fence = fences[region];
+    if (fence) {
+        // With three regions this is normally already signalled
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED) {
+            ++stalls;
+            do {
+                result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            } while (result == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+}
+
+StreamBuffer::Allocation StreamBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment) {
+    Allocation allocation;
+    GLsizeiptr start = (head + alignment - 1) / alignment * alignment;
+    if (start + size > regionSize) {
+        return allocation;
+    }
+    head = start + size;
+
+    if (persistent) {
+        allocation.offset = region * regionSize + start;
+        allocation.ptr = mapped + allocation.offset;
+    } else {
+        allocation.offset = start;
+        allocation.ptr = staging.data() + start;
+    }
+    allocation.size = size;
+    return allocation;
+}
+
+void StreamBuffer::commit() {
+    // Coherent persistent mappings are visible to the GPU as soon as they're written
+    if (persistent || committed == head) {
+        committed = head;
+        return;
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, bufferID);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, committed, head - committed, staging.data() + committed);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    committed = head;
+}
+
+void StreamBuffer::endFrame() {
+    commit();
+    if (persistent) {
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+
+// Ring-buffered streaming buffer for data that is rewritten every frame
+// (matrices, instance offsets, ...). The buffer is split into FRAME_REGIONS
+// regions and each frame bump-allocates out of its own region. A fence guards
+// every region so the CPU never writes memory the GPU is still reading.
+class StreamBuffer {
+public:
+    static const int FRAME_REGIONS = 3;
+
+    struct Allocation {
+        void* ptr = nullptr;   // CPU write pointer, valid until the next beginFrame()
+        GLintptr offset = 0;   // Offset into buffer() for glBindBufferRange / attribute pointers
+        GLsizeiptr size = 0;
+    };
+
+    bool create(GLsizeiptr bytesPerFrame);
+    void destroy();
+
+    // Waits for this frame's region to be released by the GPU and resets the bump pointer
+    void beginFrame();
+    // Returns an allocation with ptr == nullptr when the region is exhausted
+    Allocation allocate(GLsizeiptr size, GLsizeiptr alignment = 16);
+    // Makes everything allocated so far visible to the GPU. Call before drawing with it.
+    void commit();
+    // Fences the region so it is not reused until the GPU has consumed it
+    void endFrame();
+
+    GLuint buffer() const { return bufferID; }
+    bool isPersistent() const { return persistent; }
+    unsigned int stallCount() const { return stalls; }
+
+private:
+    GLuint bufferID = 0;
+    GLsizeiptr regionSize = 0;
+    GLsizeiptr head = 0;       // Bump pointer within the current region
+    GLsizeiptr committed = 0;  // Bytes of the current region already visible to the GPU
+    int region = 0;
+    bool persistent = false;
+    unsigned int stalls = 0;
+
+    // Persistent path: one mapping for the whole buffer, one fence per region
+    unsigned char* mapped = nullptr;
+    GLsync fences[FRAME_REGIONS] = {};
+
+    // Orphaning path: writes go to a CPU staging copy and are uploaded on commit()
+    std::vector<unsigned char> staging;
+};
@@ -0,0 +1,548 @@
+#include "terrainbvh.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+const int SAH_BINS = 12;
+const uint32_t MAX_LEAF_TRIANGLES = 4;
+const int STACK_SIZE = 64;
+// Traversal pushes at most one node per level (a packet two, popping one), so
+// deeper trees could overflow the stacks. Nodes this deep become leaves.
+const uint32_t MAX_DEPTH = STACK_SIZE - 2;
+const float MISS = std::numeric_limits<float>::infinity();
+
+// Far enough that zero direction components never produce NaNs in the slab test
+glm::vec3 inverseDirection(const glm::vec3& direction) {
+    glm::vec3 inverse;
+    for (int a = 0; a < 3; ++a) {
+        inverse[a] = direction[a] != 0.0f ? 1.0f / direction[a] : std::copysign(1.0e30f, direction[a]);
+    }
+    return inverse;
+}
+
+} // namespace
+
+void TerrainBVH::Bounds::grow(const glm::vec3& point) {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+}
+
+void TerrainBVH::Bounds::grow(const Bounds& other) {
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+}
+
+float TerrainBVH::Bounds::area() const {
+    glm::vec3 extent = max - min;
+    return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+namespace {
+
+template <typename Node>
+void setBounds(Node& node, const glm::vec3& min, const glm::vec3& max) {
+    for (int a = 0; a < 3; ++a) {
+        node.min[a] = min[a];
+        node.max[a] = max[a];
+    }
+}
+
+// Distance at which the ray enters the node's box, or MISS if it doesn't within (0, tMax)
+template <typename Node>
+float enterBox(const Node& node, const glm::vec3& origin, const glm::vec3& inverse, float tMax) {
+    float t1 = (node.min[0] - origin.x) * inverse.x, t2 = (node.max[0] - origin.x) * inverse.x;
+    float tNear = std::min(t1, t2), tFar = std::max(t1, t2);
+    t1 = (node.min[1] - origin.y) * inverse.y;
+    t2 = (node.max[1] - origin.y) * inverse.y;
+    tNear = std::max(tNear, std::min(t1, t2));
+    tFar = std::min(tFar, std::max(t1, t2));
+    t1 = (node.min[2] - origin.z) * inverse.z;
+    t2 = (node.max[2] - origin.z) * inverse.z;
+    tNear = std::max(tNear, std::min(t1, t2));
+    tFar = std::min(tFar, std::max(t1, t2));
+    return tFar >= tNear && tNear < tMax && tFar > 0.0f ? tNear : MISS;
+}
+
+// Depth-first walk, nearer child first. leaf(node) returns true to stop early.
+template <typename Node, typename Leaf>
+void walk(const std::vector<Node>& nodes, const glm::vec3& origin, const glm::vec3& inverse, const float& tMax, Leaf leaf) {
+    if (nodes.empty() || enterBox(nodes[0], origin, inverse, tMax) == MISS) {
+        return;
+    }
+    uint32_t stack[STACK_SIZE];
+    int depth = 0;
+    uint32_t index = 0;
+    for (;;) {
+        const Node& node = nodes[index];
+        if (node.count) {
+            if (leaf(node) || depth == 0) {
+                return;
+            }
+            index = stack[--depth];
+            continue;
+        }
+        uint32_t near = node.leftFirst, far = node.leftFirst + 1;
+        float tNear = enterBox(nodes[near], origin, inverse, tMax);
+        float tFar = enterBox(nodes[far], origin, inverse, tMax);
+        if (tFar < tNear) {
+            std::swap(near, far);
+            std::swap(tNear, tFar);
+        }
+        if (tNear == MISS) {
+            if (depth == 0) {
+                return;
+            }
+            index = stack[--depth];
+        } else {
+            index = near;
+            if (tFar != MISS) {
+                stack[depth++] = far;
+            }
+        }
+    }
+}
+
+// Same walk for a packet of rays; a node is entered if any active ray hits it.
+// leaf(node, mask) gets the rays that reached the leaf as a bit mask.
+template <typename Node, typename Leaf>
+void walkPacket(const std::vector<Node>& nodes, const glm::vec3* origins, const glm::vec3* inverses, const float* tMax, int count,
+                Leaf leaf) {
+    if (nodes.empty()) {
+        return;
+    }
+    uint32_t stack[STACK_SIZE];
+    int depth = 0;
+    stack[depth++] = 0;
+    while (depth > 0) {
+        const Node& node = nodes[stack[--depth]];
+        // Retest on the way down too; rays may have found closer hits since the push
+        unsigned int mask = 0;
+        float nearest = MISS;
+        for (int i = 0; i < count; ++i) {
+            float t = enterBox(node, origins[i], inverses[i], tMax[i]);
+            if (t != MISS) {
+                mask |= 1u << i;
+                nearest = std::min(nearest, t);
+            }
+        }
+        if (!mask) {
+            continue;
+        }
+        if (node.count) {
+            leaf(node, mask);
+            continue;
+        }
+
+        // Push the farther child first so the nearer one is popped next
+        int first = 0;
+        while (!(mask & (1u << first))) {
+            ++first;
+        }
+        const Node& left = nodes[node.leftFirst];
+        const Node& right = nodes[node.leftFirst + 1];
+        float leftDistance = 0.0f, rightDistance = 0.0f;
+        for (int a = 0; a < 3; ++a) {
+            float d = (left.min[a] + left.max[a]) * 0.5f - origins[first][a];
+            leftDistance += d * d;
+            d = (right.min[a] + right.max[a]) * 0.5f - origins[first][a];
+            rightDistance += d * d;
+        }
+        bool leftFirst = leftDistance <= rightDistance;
+        stack[depth++] = leftFirst ? node.leftFirst + 1 : node.leftFirst;
+        stack[depth++] = leftFirst ? node.leftFirst : node.leftFirst + 1;
+    }
+}
+
+template <typename Triangle>
+bool hitTriangle(const Triangle& triangle, const glm::vec3& origin, const glm::vec3& direction, float& t, float& u, float& v) {
+    glm::vec3 h = glm::cross(direction, triangle.e2);
+    float a = glm::dot(triangle.e1, h);
+    if (std::abs(a) < 1e-8f) {
+        return false; // Parallel to the triangle
+    }
+    float f = 1.0f / a;
+    glm::vec3 s = origin - triangle.v0;
+    u = f * glm::dot(s, h);
+    if (u < 0.0f || u > 1.0f) {
+        return false;
+    }
+    glm::vec3 q = glm::cross(s, triangle.e1);
+    v = f * glm::dot(direction, q);
+    if (v < 0.0f || u + v > 1.0f) {
+        return false;
+    }
+    t = f * glm::dot(triangle.e2, q);
+    return t > 1e-5f;
+}
+
+} // namespace
+
+void TerrainBVH::build(const std::vector<float>& vertices, int gridWidth, int gridHeight, WorkerPool* workers) {
+    clear();
+    if (gridWidth < 2 || gridHeight < 2) {
+        return;
+    }
+    width = gridWidth;
+    height = gridHeight;
+    tileCountX = (width - 1 + TERRAIN_TILE_CELLS - 1) / TERRAIN_TILE_CELLS;
+    tileCountZ = (height - 1 + TERRAIN_TILE_CELLS - 1) / TERRAIN_TILE_CELLS;
+
+    tiles.resize(tileCountX * tileCountZ);
+    for (int tz = 0; tz < tileCountZ; ++tz) {
+        for (int tx = 0; tx < tileCountX; ++tx) {
+            Tile& tile = tiles[tz * tileCountX + tx];
+            tile.cellX = tx * TERRAIN_TILE_CELLS;
+            tile.cellZ = tz * TERRAIN_TILE_CELLS;
+            tile.cellsX = std::min(TERRAIN_TILE_CELLS, width - 1 - tile.cellX);
+            tile.cellsZ = std::min(TERRAIN_TILE_CELLS, height - 1 - tile.cellZ);
+        }
+    }
+
+    // Tiles are independent, so each can be built on its own thread
+    if (workers && workers->threadCount() > 0) {
+        workers->parallelFor(static_cast<int>(tiles.size()), [&](int i) { buildTile(tiles[i], vertices); });
+    } else {
+        for (Tile& tile : tiles) {
+            buildTile(tile, vertices);
+        }
+    }
+    buildTop();
+}
+
+void TerrainBVH::updateTile(int tileX, int tileZ, const std::vector<float>& vertices, bool refit) {
+    if (tileX < 0 || tileZ < 0 || tileX >= tileCountX || tileZ >= tileCountZ) {
+        return;
+    }
+    Tile& tile = tiles[tileZ * tileCountX + tileX];
+    if (refit) {
+        std::vector<Bounds> primitives(tile.triangles.size());
+        for (size_t i = 0; i < tile.triangles.size(); ++i) {
+            Triangle& triangle = tile.triangles[i];
+            triangle = makeTriangle(vertices, triangle.id);
+            primitives[i].grow(triangle.v0);
+            primitives[i].grow(triangle.v0 + triangle.e1);
+            primitives[i].grow(triangle.v0 + triangle.e2);
+        }
+        refitNodes(tile.nodes, primitives);
+    } else {
+        buildTile(tile, vertices);
+    }
+
+    // The tile's box may have changed; the tree over the tiles keeps its shape
+    std::vector<Bounds> tileBoxes(tileOrder.size());
+    for (size_t i = 0; i < tileOrder.size(); ++i) {
+        tileBoxes[i] = tileBounds(tiles[tileOrder[i]]);
+    }
+    refitNodes(top, tileBoxes);
+}
+
+void TerrainBVH::clear() {
+    width = height = tileCountX = tileCountZ = 0;
+    tiles.clear();
+    top.clear();
+    tileOrder.clear();
+}
+
+TerrainBVH::Triangle TerrainBVH::makeTriangle(const std::vector<float>& vertices, int id) const {
+    // Each cell is split along its (x, z) to (x + 1, z + 1) diagonal
+    int cell = id / 2;
+    int x = cell % (width - 1), z = cell / (width - 1);
+    auto vertex = [&](int vx, int vz) {
+        const float* v = &vertices[(static_cast<size_t>(vz) * width + vx) * 3];
+        return glm::vec3(v[0], v[1], v[2]);
+    };
+    glm::vec3 a = vertex(x, z), c = vertex(x + 1, z + 1);
+    glm::vec3 b = (id & 1) ? vertex(x + 1, z) : vertex(x, z + 1);
+
+    Triangle triangle;
+    triangle.v0 = a;
+    triangle.e1 = b - a;
+    triangle.e2 = c - a;
+    triangle.id = id;
+    return triangle;
+}
+
+void TerrainBVH::buildTile(Tile& tile, const std::vector<float>& vertices) {
+    std::vector<Triangle> triangles;
+    std::vector<Bounds> primitives;
+    triangles.reserve(tile.cellsX * tile.cellsZ * 2);
+    primitives.reserve(tile.cellsX * tile.cellsZ * 2);
+    for (int z = tile.cellZ; z < tile.cellZ + tile.cellsZ; ++z) {
+        for (int x = tile.cellX; x < tile.cellX + tile.cellsX; ++x) {
+            for (int half = 0; half < 2; ++half) {
+                Triangle triangle = makeTriangle(vertices, (z * (width - 1) + x) * 2 + half);
+                Bounds bounds;
+                bounds.grow(triangle.v0);
+                bounds.grow(triangle.v0 + triangle.e1);
+                bounds.grow(triangle.v0 + triangle.e2);
+                triangles.push_back(triangle);
+                primitives.push_back(bounds);
+            }
+        }
+    }
+
+    // Store the triangles in leaf order so a leaf is one contiguous run
+    std::vector<uint32_t> order;
+    buildNodes(primitives, order, tile.nodes);
+    tile.triangles.resize(triangles.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        tile.triangles[i] = triangles[order[i]];
+    }
+}
+
+void TerrainBVH::buildTop() {
+    std::vector<Bounds> primitives(tiles.size());
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        primitives[i] = tileBounds(tiles[i]);
+    }
+    buildNodes(primitives, tileOrder, top);
+}
+
+TerrainBVH::Bounds TerrainBVH::tileBounds(const Tile& tile) const {
+    Bounds bounds;
+    if (!tile.nodes.empty()) {
+        const Node& root = tile.nodes[0];
+        bounds.grow(glm::vec3(root.min[0], root.min[1], root.min[2]));
+        bounds.grow(glm::vec3(root.max[0], root.max[1], root.max[2]));
+    }
+    return bounds;
+}
+
+void TerrainBVH::buildNodes(const std::vector<Bounds>& primitives, std::vector<uint32_t>& order, std::vector<Node>& nodes) {
+    order.resize(primitives.size());
+    std::iota(order.begin(), order.end(), 0u);
+    nodes.clear();
+    if (primitives.empty()) {
+        return;
+    }
+    nodes.reserve(primitives.size() * 2);
+
+    Bounds bounds;
+    for (const Bounds& primitive : primitives) {
+        bounds.grow(primitive);
+    }
+    Node root;
+    setBounds(root, bounds.min, bounds.max);
+    root.leftFirst = 0;
+    root.count = static_cast<uint32_t>(primitives.size());
+    nodes.push_back(root);
+    subdivide(primitives, order, nodes, 0, 0);
+    nodes.shrink_to_fit();
+}
+
+void TerrainBVH::subdivide(const std::vector<Bounds>& primitives, std::vector<uint32_t>& order, std::vector<Node>& nodes, uint32_t index,
+                           uint32_t depth) {
+    Node node = nodes[index];
+    if (node.count <= MAX_LEAF_TRIANGLES || depth >= MAX_DEPTH) {
+        return;
+    }
+    uint32_t first = node.leftFirst, last = node.leftFirst + node.count;
+    auto centre = [&](uint32_t i) { return (primitives[order[i]].min + primitives[order[i]].max) * 0.5f; };
+
+    Bounds centres;
+    for (uint32_t i = first; i < last; ++i) {
+        centres.grow(centre(i));
+    }
+
+    // Binned SAH: cost of splitting at every bin boundary on every axis
+    float bestCost = MISS;
+    int bestAxis = -1, bestSplit = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        float lo = centres.min[axis], hi = centres.max[axis];
+        if (hi <= lo) {
+            continue;
+        }
+        Bounds bins[SAH_BINS];
+        int counts[SAH_BINS] = {};
+        float scale = SAH_BINS / (hi - lo);
+        for (uint32_t i = first; i < last; ++i) {
+            int bin = std::min(SAH_BINS - 1, static_cast<int>((centre(i)[axis] - lo) * scale));
+            ++counts[bin];
+            bins[bin].grow(primitives[order[i]]);
+        }
+
+        float leftArea[SAH_BINS - 1];
+        int leftCount[SAH_BINS - 1];
+        Bounds left;
+        int leftSum = 0;
+        for (int i = 0; i < SAH_BINS - 1; ++i) {
+            leftSum += counts[i];
+            if (counts[i]) {
+                left.grow(bins[i]);
+            }
+            leftCount[i] = leftSum;
+            leftArea[i] = leftSum ? left.area() : 0.0f;
+        }
+        Bounds right;
+        int rightSum = 0;
+        for (int i = SAH_BINS - 1; i > 0; --i) {
+            rightSum += counts[i];
+            if (counts[i]) {
+                right.grow(bins[i]);
+            }
+            float cost = leftCount[i - 1] * leftArea[i - 1] + rightSum * (rightSum ? right.area() : 0.0f);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = i;
+            }
+        }
+    }
+
+    Bounds nodeBounds;
+    nodeBounds.grow(glm::vec3(node.min[0], node.min[1], node.min[2]));
+    nodeBounds.grow(glm::vec3(node.max[0], node.max[1], node.max[2]));
+    if (bestAxis < 0 || bestCost >= node.count * nodeBounds.area()) {
+        return; // Splitting wouldn't pay for itself
+    }
+
+    // Partition the primitives around the chosen bin boundary
+    float lo = centres.min[bestAxis];
+    float scale = SAH_BINS / (centres.max[bestAxis] - lo);
+    uint32_t i = first, j = last;
+    while (i < j) {
+        int bin = std::min(SAH_BINS - 1, static_cast<int>((centre(i)[bestAxis] - lo) * scale));
+        if (bin < bestSplit) {
+            ++i;
+        } else {
+            std::swap(order[i], order[--j]);
+        }
+    }
+    if (i == first || i == last) {
+        return;
+    }
+
+    Node children[2];
+    uint32_t ranges[2][2] = { { first, i }, { i, last } };
+    for (int c = 0; c < 2; ++c) {
+        Bounds bounds;
+        for (uint32_t k = ranges[c][0]; k < ranges[c][1]; ++k) {
+            bounds.grow(primitives[order[k]]);
+        }
+        setBounds(children[c], bounds.min, bounds.max);
+        children[c].leftFirst = ranges[c][0];
+        children[c].count = ranges[c][1] - ranges[c][0];
+    }
+    uint32_t left = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(children[0]);
+    nodes.push_back(children[1]);
+    nodes[index].leftFirst = left;
+    nodes[index].count = 0;
+    subdivide(primitives, order, nodes, left, depth + 1);
+    subdivide(primitives, order, nodes, left + 1, depth + 1);
+}
+
+void TerrainBVH::refitNodes(std::vector<Node>& nodes, const std::vector<Bounds>& primitives) {
+    // Children always come after their parent, so walking backwards sees them first
+    for (size_t n = nodes.size(); n-- > 0;) {
+        Node& node = nodes[n];
+        Bounds bounds;
+        if (node.count) {
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+                bounds.grow(primitives[i]);
+            }
+        } else {
+            for (uint32_t child = node.leftFirst; child < node.leftFirst + 2; ++child) {
+                bounds.grow(glm::vec3(nodes[child].min[0], nodes[child].min[1], nodes[child].min[2]));
+                bounds.grow(glm::vec3(nodes[child].max[0], nodes[child].max[1], nodes[child].max[2]));
+            }
+        }
+        setBounds(node, bounds.min, bounds.max);
+    }
+}
+
+bool TerrainBVH::intersect(const TerrainRay& ray, TerrainHit& hit) const {
+    return trace(ray, hit, false);
+}
+
+bool TerrainBVH::segmentBlocked(const glm::vec3& from, const glm::vec3& to) const {
+    float length = glm::length(to - from);
+    if (length <= 0.0f) {
+        return false;
+    }
+    TerrainHit hit;
+    return trace({ from, (to - from) / length, length }, hit, true);
+}
+
+bool TerrainBVH::trace(const TerrainRay& ray, TerrainHit& hit, bool anyHit) const {
+    hit = TerrainHit();
+    float tMax = ray.maxDistance;
+    glm::vec3 inverse = inverseDirection(ray.direction);
+    bool done = false;
+    walk(top, ray.origin, inverse, tMax, [&](const Node& leaf) {
+        for (uint32_t i = leaf.leftFirst; i < leaf.leftFirst + leaf.count && !done; ++i) {
+            traceTile(tiles[tileOrder[i]], ray.origin, ray.direction, inverse, tMax, hit, anyHit);
+            done = anyHit && hit.triangle >= 0;
+        }
+        return done;
+    });
+    return hit.triangle >= 0;
+}
+
+void TerrainBVH::traceTile(const Tile& tile, const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& inverse, float& tMax,
+                           TerrainHit& hit, bool anyHit) const {
+    walk(tile.nodes, origin, inverse, tMax, [&](const Node& leaf) {
+        for (uint32_t i = leaf.leftFirst; i < leaf.leftFirst + leaf.count; ++i) {
+            float t, u, v;
+            if (hitTriangle(tile.triangles[i], origin, direction, t, u, v) && t < tMax) {
+                tMax = t;
+                hit.distance = t;
+                hit.triangle = tile.triangles[i].id;
+                hit.u = u;
+                hit.v = v;
+                if (anyHit) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    });
+}
+
+void TerrainBVH::intersectPacket(const TerrainRay* rays, int count, TerrainHit* hits) const {
+    for (int base = 0; base < count; base += TERRAIN_PACKET_SIZE) {
+        int size = std::min(TERRAIN_PACKET_SIZE, count - base);
+        glm::vec3 origins[TERRAIN_PACKET_SIZE], directions[TERRAIN_PACKET_SIZE], inverses[TERRAIN_PACKET_SIZE];
+        float tMax[TERRAIN_PACKET_SIZE];
+        for (int i = 0; i < size; ++i) {
+            origins[i] = rays[base + i].origin;
+            directions[i] = rays[base + i].direction;
+            inverses[i] = inverseDirection(directions[i]);
+            tMax[i] = rays[base + i].maxDistance;
+            hits[base + i] = TerrainHit();
+        }
+
+        walkPacket(top, origins, inverses, tMax, size, [&](const Node& topLeaf, unsigned int) {
+            for (uint32_t t = topLeaf.leftFirst; t < topLeaf.leftFirst + topLeaf.count; ++t) {
+                const Tile& tile = tiles[tileOrder[t]];
+                walkPacket(tile.nodes, origins, inverses, tMax, size, [&](const Node& leaf, unsigned int mask) {
+                    for (uint32_t k = leaf.leftFirst; k < leaf.leftFirst + leaf.count; ++k) {
+                        const Triangle& triangle = tile.triangles[k];
+                        for (int i = 0; i < size; ++i) {
+                            float distance, u, v;
+                            if ((mask & (1u << i)) && hitTriangle(triangle, origins[i], directions[i], distance, u, v) &&
+                                distance < tMax[i]) {
+                                tMax[i] = distance;
+                                hits[base + i].distance = distance;
+                                hits[base + i].triangle = triangle.id;
+                                hits[base + i].u = u;
+                                hits[base + i].v = v;
+                            }
+                        }
+                    }
+                });
+            }
+        });
+    }
+}
+
+size_t TerrainBVH::memoryBytes() const {
+    size_t bytes = top.size() * sizeof(Node) + tileOrder.size() * sizeof(uint32_t);
+    for (const Tile& tile : tiles) {
+        bytes += sizeof(Tile) + tile.nodes.size() * sizeof(Node) + tile.triangles.size() * sizeof(Triangle);
+    }
+    return bytes;
+}
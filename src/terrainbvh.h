@@ -0,0 +1,97 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "workerpool.h"
+
+#define TERRAIN_TILE_CELLS 32 // Heightmap cells along each edge of a BVH tile
+#define TERRAIN_PACKET_SIZE 4 // Rays traced together by intersectPacket()
+
+struct TerrainRay {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float maxDistance;
+};
+
+struct TerrainHit {
+    float distance = -1.0f; // Negative for a miss
+    int triangle = -1;      // (cellZ * (width - 1) + cellX) * 2 + half
+    float u = 0.0f, v = 0.0f; // Barycentrics of the hit within the triangle
+};
+
+// Bounding volume hierarchy over the heightmap terrain, for picking, line of
+// sight and placing things on the ground. The terrain is cut into tiles of
+// TERRAIN_TILE_CELLS cells; every tile has its own SAH-built BVH and a small
+// BVH over the tiles ties them together, so one tile can be rebuilt or refitted
+// when its heights change without touching the rest. Nodes are flattened into
+// 32-byte records (two per cache line) and children are always stored after
+// their parent, which lets a refit walk the array backwards.
+class TerrainBVH {
+public:
+    // Takes the width x height grid of xyz vertices from generateTerrainVertices.
+    // Tiles are built in parallel when a worker pool is given.
+    void build(const std::vector<float>& vertices, int width, int height, WorkerPool* workers = nullptr);
+    // Picks up new heights in one tile. Refitting keeps the tree and only grows
+    // or shrinks its boxes, which is enough for small edits; rebuild otherwise.
+    void updateTile(int tileX, int tileZ, const std::vector<float>& vertices, bool refit);
+    void clear();
+
+    // Closest hit along the ray within its maxDistance
+    bool intersect(const TerrainRay& ray, TerrainHit& hit) const;
+    // Traces rays TERRAIN_PACKET_SIZE at a time, sharing the walk down the tree.
+    // Worth it for coherent rays such as a grid of samples over the view.
+    void intersectPacket(const TerrainRay* rays, int count, TerrainHit* hits) const;
+    // Whether the terrain blocks the straight line between two points
+    bool segmentBlocked(const glm::vec3& from, const glm::vec3& to) const;
+
+    int tilesX() const { return tileCountX; }
+    int tilesZ() const { return tileCountZ; }
+    size_t memoryBytes() const;
+
+private:
+    struct alignas(32) Node {
+        float min[3];
+        uint32_t leftFirst; // Interior: index of the left child, the right one follows. Leaf: first primitive.
+        float max[3];
+        uint32_t count;     // Primitives in a leaf, 0 for interior nodes
+    };
+
+    // Stored ready for Moller-Trumbore
+    struct Triangle {
+        glm::vec3 v0, e1, e2;
+        int id;
+    };
+
+    struct Tile {
+        int cellX = 0, cellZ = 0, cellsX = 0, cellsZ = 0;
+        std::vector<Node> nodes;
+        std::vector<Triangle> triangles;
+    };
+
+    struct Bounds {
+        glm::vec3 min = glm::vec3(3.0e38f);
+        glm::vec3 max = glm::vec3(-3.0e38f);
+        void grow(const glm::vec3& point);
+        void grow(const Bounds& other);
+        float area() const;
+    };
+
+    static void buildNodes(const std::vector<Bounds>& primitives, std::vector<uint32_t>& order, std::vector<Node>& nodes);
+    static void subdivide(const std::vector<Bounds>& primitives, std::vector<uint32_t>& order, std::vector<Node>& nodes, uint32_t index,
+                          uint32_t depth);
+    static void refitNodes(std::vector<Node>& nodes, const std::vector<Bounds>& primitives);
+    void buildTile(Tile& tile, const std::vector<float>& vertices);
+    Triangle makeTriangle(const std::vector<float>& vertices, int id) const;
+    void buildTop();
+    Bounds tileBounds(const Tile& tile) const;
+
+    bool trace(const TerrainRay& ray, TerrainHit& hit, bool anyHit) const;
+    void traceTile(const Tile& tile, const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& inverse, float& tMax,
+                   TerrainHit& hit, bool anyHit) const;
+
+    int width = 0, height = 0;
+    int tileCountX = 0, tileCountZ = 0;
+    std::vector<Tile> tiles;
+    std::vector<Node> top;        // Leaves index tileOrder
+    std::vector<uint32_t> tileOrder;
+};
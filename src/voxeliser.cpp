@@ -0,0 +1,88 @@
+#include "voxeliser.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int DIRT_DEPTH = 3; // Dirt voxels between the grass top and the stone below
+
+} // namespace
+
+void buildColumns(const HeightField& field, const ChunkCoord& coord, ChunkColumns& columns) {
+    columns.runs.clear();
+    for (int z = 0; z < CHUNK_SIZE; ++z) {
+        for (int x = 0; x < CHUNK_SIZE; ++x) {
+            columns.first[z * CHUNK_SIZE + x] = static_cast<uint16_t>(columns.runs.size());
+
+            float height = field.heightAt(coord.first * CHUNK_SIZE + x, coord.second * CHUNK_SIZE + z);
+            if (height < 0.0f) {
+                continue; // Off the map: empty column
+            }
+
+            // At least one voxel per column so the map has a floor
+            int solid = 1 + static_cast<int>(std::floor(height));
+            int dirt = std::min(DIRT_DEPTH, solid - 1);
+            int stone = solid - 1 - dirt;
+            if (stone > 0) {
+                columns.runs.push_back({ BLOCK_STONE, static_cast<uint16_t>(stone) });
+            }
+            if (dirt > 0) {
+                columns.runs.push_back({ BLOCK_DIRT, static_cast<uint16_t>(dirt) });
+            }
+            columns.runs.push_back({ BLOCK_GRASS, 1 });
+        }
+    }
+    columns.first[CHUNK_SIZE * CHUNK_SIZE] = static_cast<uint16_t>(columns.runs.size());
+}
+
+void columnsToVoxels(const ChunkColumns& columns, ChunkVoxels& voxels) {
+    // Most voxels are whatever the tallest stacks are made of; start from that
+    int stoneVoxels = 0, airVoxels = 0;
+    for (int i = 0; i < CHUNK_SIZE * CHUNK_SIZE; ++i) {
+        int filled = 0;
+        for (int r = columns.first[i]; r < columns.first[i + 1]; ++r) {
+            if (columns.runs[r].block == BLOCK_STONE) {
+                stoneVoxels += std::min<int>(columns.runs[r].length, CHUNK_SIZE - filled);
+            }
+            filled += columns.runs[r].length;
+        }
+        airVoxels += std::max(0, CHUNK_SIZE - filled);
+    }
+    BlockID background = stoneVoxels > airVoxels ? BLOCK_STONE : BLOCK_AIR;
+    voxels.fill(background);
+
+    for (int z = 0; z < CHUNK_SIZE; ++z) {
+        for (int x = 0; x < CHUNK_SIZE; ++x) {
+            int i = z * CHUNK_SIZE + x;
+            int y = 0;
+            for (int r = columns.first[i]; r < columns.first[i + 1] && y < CHUNK_SIZE; ++r) {
+                const ColumnRun& run = columns.runs[r];
+                int end = std::min(CHUNK_SIZE, y + run.length);
+                if (run.block == background) {
+                    y = end; // Already there
+                    continue;
+                }
+                for (; y < end; ++y) {
+                    voxels.set(x, y, z, run.block);
+                }
+            }
+            if (background != BLOCK_AIR) {
+                for (; y < CHUNK_SIZE; ++y) {
+                    voxels.set(x, y, z, BLOCK_AIR);
+                }
+            }
+        }
+    }
+}
+
+int solidFloor(const ChunkColumns& columns) {
+    int floor = CHUNK_SIZE;
+    for (int i = 0; i < CHUNK_SIZE * CHUNK_SIZE && floor > 0; ++i) {
+        int solid = 0;
+        for (int r = columns.first[i]; r < columns.first[i + 1] && columns.runs[r].block != BLOCK_AIR; ++r) {
+            solid += columns.runs[r].length;
+        }
+        floor = std::min(floor, solid);
+    }
+    return floor;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "chunkcoord.h"
+#include "chunkvoxels.h"
+
+// The loaded heightmap, kept around so chunks can be voxelised on demand
+struct HeightField {
+    std::vector<float> samples; // Normalised [0, 1], row-major
+    int width = 0;
+    int height = 0;
+    float heightScale = 1.0f;   // World units at a sample of 1.0
+
+    bool contains(int x, int z) const { return x >= 0 && z >= 0 && x < width && z < height; }
+    // World-space height at sample (x, z), or -1 outside the map
+    float heightAt(int x, int z) const { return contains(x, z) ? samples[z * width + x] * heightScale : -1.0f; }
+};
+
+// One run of identical blocks in a column, bottom to top
+struct ColumnRun {
+    BlockID block;
+    uint16_t length;
+};
+
+// Run-length encoded columns of a chunk: a column of any height is a handful of runs
+struct ChunkColumns {
+    std::vector<ColumnRun> runs;
+    uint16_t first[CHUNK_SIZE * CHUNK_SIZE + 1]; // Runs of column (x, z) are [first[i], first[i + 1]), i = z * CHUNK_SIZE + x
+};
+
+// Turns the heightmap under a chunk into columns: stone up to the scaled height,
+// capped with dirt and a grass top, air above
+void buildColumns(const HeightField& field, const ChunkCoord& coord, ChunkColumns& columns);
+// Writes the bottom CHUNK_SIZE voxels of the columns into the chunk. The chunk
+// starts as a single value and only voxels that differ from it are written, so
+// tall uniform stacks cost nothing.
+void columnsToVoxels(const ChunkColumns& columns, ChunkVoxels& voxels);
+// Voxels from the bottom of the chunk up that are solid in every column, for
+// use as an occluder; 0 if any column starts with air
+int solidFloor(const ChunkColumns& columns);
@@ -0,0 +1,342 @@
+#include "voxeltree.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const size_t MIN_COMPACT_SLOTS = 4096; // Unused brick slots worth compacting the pool for, at the least
+
+int floorDiv(int value, int divisor) {
+    return (value >= 0 ? value : value - divisor + 1) / divisor;
+}
+
+// Amanatides-Woo over a grid of cells Width x Height x Width voxels, limited to
+// the cells first to last (the sizes are constants so the divisions are cheap).
+// Calls visit(cell, tEnter, tExit, normal) for each cell the ray crosses between
+// t and tEnd, nearest first, until it returns true.
+template <int Width, int Height, typename Visit>
+bool walkCells(const glm::vec3& start, const glm::vec3& dir, float t, float tEnd, glm::ivec3 normal, const glm::ivec3& first,
+               const glm::ivec3& last, Visit visit) {
+    const glm::ivec3 size(Width, Height, Width);
+    glm::vec3 p = start + dir * t;
+    glm::ivec3 cell, step;
+    glm::vec3 tMax, tDelta;
+    for (int a = 0; a < 3; ++a) {
+        // Clamp so points on the boundary start in the range
+        int c = floorDiv(static_cast<int>(std::floor(p[a])), size[a]);
+        cell[a] = std::max(first[a], std::min(last[a], c));
+        if (dir[a] > 0.0f) {
+            step[a] = 1;
+            tMax[a] = ((cell[a] + 1) * size[a] - start[a]) / dir[a];
+            tDelta[a] = size[a] / dir[a];
+        } else if (dir[a] < 0.0f) {
+            step[a] = -1;
+            tMax[a] = (cell[a] * size[a] - start[a]) / dir[a];
+            tDelta[a] = -size[a] / dir[a];
+        } else {
+            step[a] = 0;
+            tMax[a] = tDelta[a] = std::numeric_limits<float>::infinity();
+        }
+    }
+
+    for (;;) {
+        int a = tMax.x < tMax.y ? (tMax.x < tMax.z ? 0 : 2) : (tMax.y < tMax.z ? 1 : 2);
+        if (visit(cell, t, std::min(tMax[a], tEnd), normal)) {
+            return true;
+        }
+        if (tMax[a] > tEnd) {
+            return false;
+        }
+        t = tMax[a];
+        cell[a] += step[a];
+        tMax[a] += tDelta[a];
+        normal = glm::ivec3(0);
+        normal[a] = -step[a];
+        if (cell[a] < first[a] || cell[a] > last[a]) {
+            return false;
+        }
+    }
+}
+
+} // namespace
+
+ChunkCoord VoxelTree::regionOf(const ChunkCoord& coord) {
+    return std::make_pair(floorDiv(coord.first, REGION_SIZE), floorDiv(coord.second, REGION_SIZE));
+}
+
+int VoxelTree::regionBit(const ChunkCoord& coord) {
+    int x = coord.first - floorDiv(coord.first, REGION_SIZE) * REGION_SIZE;
+    int z = coord.second - floorDiv(coord.second, REGION_SIZE) * REGION_SIZE;
+    return z * REGION_SIZE + x;
+}
+
+uint64_t VoxelTree::brick(const Node& node, int index) const {
+    // Bricks are packed in bit order, so a brick's slot is the number of set bits below it
+    return brickPool[node.firstBrick + __builtin_popcountll(node.brickMask & ((1ull << index) - 1))];
+}
+
+void VoxelTree::update(const ChunkCoord& coord, const ChunkVoxels& voxels) {
+    if (voxels.isEmpty()) {
+        remove(coord);
+        return;
+    }
+
+    uint64_t bricks[64] = {};
+    Node node;
+    node.solidMin = glm::ivec3(CHUNK_SIZE);
+    node.solidMax = glm::ivec3(-1);
+    voxels.forEachSolid([&](int x, int y, int z, BlockID) {
+        int b = brickIndex(x / BRICK_SIZE, y / BRICK_SIZE, z / BRICK_SIZE);
+        bricks[b] |= 1ull << voxelBit(x % BRICK_SIZE, y % BRICK_SIZE, z % BRICK_SIZE);
+        node.solidMin = glm::min(node.solidMin, glm::ivec3(x, y, z));
+        node.solidMax = glm::max(node.solidMax, glm::ivec3(x, y, z));
+    });
+
+    for (int b = 0; b < 64; ++b) {
+        if (bricks[b]) {
+            node.brickMask |= 1ull << b;
+        }
+    }
+    uint32_t count = static_cast<uint32_t>(__builtin_popcountll(node.brickMask));
+
+    // Reuse the chunk's old slots when the bricks still fit, otherwise take new ones at the end
+    const Node* previous = nodes.find(coord);
+    bool moved = previous && previous->brickCapacity < count;
+    if (previous && !moved) {
+        node.firstBrick = previous->firstBrick;
+        node.brickCapacity = previous->brickCapacity;
+    } else {
+        if (moved) {
+            freeBricks(*previous);
+        }
+        node.firstBrick = static_cast<uint32_t>(brickPool.size());
+        node.brickCapacity = count;
+        brickPool.resize(brickPool.size() + count);
+    }
+    uint32_t slot = node.firstBrick;
+    for (int b = 0; b < 64; ++b) {
+        if (bricks[b]) {
+            brickPool[slot++] = bricks[b];
+        }
+    }
+
+    nodes[coord] = node;
+    regions[regionOf(coord)] |= static_cast<uint16_t>(1u << regionBit(coord));
+    if (moved) {
+        compactBricks();
+    }
+}
+
+void VoxelTree::remove(const ChunkCoord& coord) {
+    const Node* node = nodes.find(coord);
+    if (!node) {
+        return;
+    }
+    freeBricks(*node);
+    nodes.erase(coord);
+    compactBricks();
+
+    ChunkCoord region = regionOf(coord);
+    uint16_t* mask = regions.find(region);
+    *mask &= static_cast<uint16_t>(~(1u << regionBit(coord)));
+    if (*mask == 0) {
+        regions.erase(region);
+    }
+}
+
+void VoxelTree::clear() {
+    nodes.clear();
+    regions.clear();
+    brickPool.clear();
+    freeBrickSlots = 0;
+}
+
+void VoxelTree::freeBricks(const Node& node) {
+    freeBrickSlots += node.brickCapacity;
+}
+
+void VoxelTree::compactBricks() {
+    if (freeBrickSlots < MIN_COMPACT_SLOTS || freeBrickSlots * 2 < brickPool.size()) {
+        return;
+    }
+    // Copy every node's bricks down to the front of a new pool, trimming spare capacity
+    std::vector<uint64_t> compacted;
+    compacted.reserve(brickPool.size() - freeBrickSlots);
+    nodes.forEach([&](const ChunkCoord&, Node& node) {
+        uint32_t count = static_cast<uint32_t>(__builtin_popcountll(node.brickMask));
+        uint32_t first = static_cast<uint32_t>(compacted.size());
+        compacted.insert(compacted.end(), brickPool.begin() + node.firstBrick, brickPool.begin() + node.firstBrick + count);
+        node.firstBrick = first;
+        node.brickCapacity = count;
+    });
+    brickPool.swap(compacted);
+    freeBrickSlots = 0;
+}
+
+bool VoxelTree::isSolid(const glm::ivec3& voxel) const {
+    if (voxel.y < 0 || voxel.y >= CHUNK_SIZE) {
+        return false;
+    }
+    ChunkCoord coord = std::make_pair(floorDiv(voxel.x, CHUNK_SIZE), floorDiv(voxel.z, CHUNK_SIZE));
+    const Node* node = nodes.find(coord);
+    if (!node) {
+        return false;
+    }
+    glm::ivec3 local(voxel.x - coord.first * CHUNK_SIZE, voxel.y, voxel.z - coord.second * CHUNK_SIZE);
+    int b = brickIndex(local.x / BRICK_SIZE, local.y / BRICK_SIZE, local.z / BRICK_SIZE);
+    if (!(node->brickMask & (1ull << b))) {
+        return false;
+    }
+    return (brick(*node, b) >> voxelBit(local.x % BRICK_SIZE, local.y % BRICK_SIZE, local.z % BRICK_SIZE)) & 1;
+}
+
+bool VoxelTree::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, VoxelRayHit& hit) const {
+    float length = glm::length(direction);
+    if (length <= 0.0f) {
+        return false;
+    }
+    glm::vec3 dir = direction / length;
+
+    // Voxel (x, y, z) is the cube centred on it; shift so voxel i spans [i, i + 1)
+    glm::vec3 start = origin + glm::vec3(0.5f);
+
+    // Clip to the slab of heights that can hold voxels
+    float t = 0.0f, tEnd = maxDistance;
+    glm::ivec3 normal(0);
+    if (dir.y != 0.0f) {
+        float t0 = (0.0f - start.y) / dir.y;
+        float t1 = (CHUNK_SIZE - start.y) / dir.y;
+        if (std::min(t0, t1) > t) {
+            t = std::min(t0, t1);
+            normal.y = dir.y < 0.0f ? 1 : -1;
+        }
+        tEnd = std::min(tEnd, std::max(t0, t1));
+    } else if (start.y < 0.0f || start.y >= CHUNK_SIZE) {
+        return false;
+    }
+    if (t > tEnd) {
+        return false;
+    }
+
+    // Chunk columns along the ray. A region's mask is looked up once when the ray
+    // enters it, so chunks in empty regions or empty chunks cost no node lookup.
+    const glm::ivec3 unbounded(std::numeric_limits<int>::max() / 2, 0, std::numeric_limits<int>::max() / 2);
+    ChunkCoord region = std::make_pair(std::numeric_limits<int>::min(), 0);
+    uint16_t regionMask = 0;
+    auto visitChunk = [&](const glm::ivec3& chunk, float tEnter, float tExit, const glm::ivec3& entered) {
+        ChunkCoord coord = std::make_pair(chunk.x, chunk.z);
+        ChunkCoord chunkRegion = regionOf(coord);
+        if (chunkRegion != region) {
+            region = chunkRegion;
+            const uint16_t* mask = regions.find(region);
+            regionMask = mask ? *mask : 0;
+        }
+        if (!(regionMask & (1u << regionBit(coord)))) {
+            return false;
+        }
+        // Skip the chunk when the ray passes wholly above or below its solid voxels
+        const Node& node = *nodes.find(coord);
+        float y0 = start.y + dir.y * tEnter, y1 = start.y + dir.y * tExit;
+        return std::min(y0, y1) < node.solidMax.y + 1 && std::max(y0, y1) > node.solidMin.y &&
+               traceChunk(node, coord, start, dir, tEnter, tExit, entered, hit);
+    };
+    return walkCells<CHUNK_SIZE, CHUNK_SIZE>(start, dir, t, tEnd, normal, -unbounded, unbounded, visitChunk);
+}
+
+int VoxelTree::raycast(const VoxelRay* rays, int count, VoxelRayHit* hits) const {
+    int found = 0;
+    for (int i = 0; i < count; ++i) {
+        if (raycast(rays[i].origin, rays[i].direction, rays[i].maxDistance, hits[i])) {
+            ++found;
+        } else {
+            hits[i].distance = -1.0f;
+        }
+    }
+    return found;
+}
+
+bool VoxelTree::traceChunk(const Node& node, const ChunkCoord& coord, const glm::vec3& start, const glm::vec3& dir, float t,
+                           float tEnd, const glm::ivec3& normal, VoxelRayHit& hit) const {
+    const int bricksAcross = CHUNK_SIZE / BRICK_SIZE;
+    glm::ivec3 firstBrick(coord.first * bricksAcross, 0, coord.second * bricksAcross);
+    glm::ivec3 lastBrick = firstBrick + glm::ivec3(bricksAcross - 1);
+    auto visitBrick = [&](const glm::ivec3& cell, float tEnter, float tExit, const glm::ivec3& entered) {
+        glm::ivec3 local = cell - firstBrick;
+        int b = brickIndex(local.x, local.y, local.z);
+        if (!(node.brickMask & (1ull << b))) {
+            return false; // Empty brick, crossed in one step
+        }
+        uint64_t voxels = brick(node, b);
+        glm::ivec3 firstVoxel = cell * BRICK_SIZE;
+        glm::ivec3 lastVoxel = firstVoxel + glm::ivec3(BRICK_SIZE - 1);
+        return walkCells<1, 1>(start, dir, tEnter, tExit, entered, firstVoxel, lastVoxel,
+                               [&](const glm::ivec3& voxel, float tVoxel, float, const glm::ivec3& face) {
+            glm::ivec3 v = voxel - firstVoxel;
+            if (!((voxels >> voxelBit(v.x, v.y, v.z)) & 1)) {
+                return false;
+            }
+            hit.voxel = voxel;
+            hit.normal = face;
+            hit.distance = tVoxel;
+            return true;
+        });
+    };
+    return walkCells<BRICK_SIZE, BRICK_SIZE>(start, dir, t, tEnd, normal, firstBrick, lastBrick, visitBrick);
+}
+
+bool VoxelTree::chunkBounds(const ChunkCoord& coord, glm::vec3& boundsMin, glm::vec3& boundsMax) const {
+    const Node* node = nodes.find(coord);
+    if (!node) {
+        return false;
+    }
+    glm::vec3 origin(coord.first * CHUNK_SIZE, 0.0f, coord.second * CHUNK_SIZE);
+    boundsMin = origin + glm::vec3(node->solidMin) - glm::vec3(0.5f);
+    boundsMax = origin + glm::vec3(node->solidMax) + glm::vec3(0.5f);
+    return true;
+}
+
+bool VoxelTree::overlaps(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const {
+    // Voxels whose cube [i - 0.5, i + 0.5] overlaps the box
+    glm::ivec3 first(static_cast<int>(std::floor(boundsMin.x + 0.5f)), static_cast<int>(std::floor(boundsMin.y + 0.5f)),
+                     static_cast<int>(std::floor(boundsMin.z + 0.5f)));
+    glm::ivec3 last(static_cast<int>(std::ceil(boundsMax.x + 0.5f)) - 1, static_cast<int>(std::ceil(boundsMax.y + 0.5f)) - 1,
+                    static_cast<int>(std::ceil(boundsMax.z + 0.5f)) - 1);
+    first.y = std::max(first.y, 0);
+    last.y = std::min(last.y, CHUNK_SIZE - 1);
+    if (first.y > last.y) {
+        return false;
+    }
+
+    for (int cx = floorDiv(first.x, CHUNK_SIZE); cx <= floorDiv(last.x, CHUNK_SIZE); ++cx) {
+        for (int cz = floorDiv(first.z, CHUNK_SIZE); cz <= floorDiv(last.z, CHUNK_SIZE); ++cz) {
+            const Node* node = nodes.find(std::make_pair(cx, cz));
+            if (!node) {
+                continue;
+            }
+            // Clip to the chunk's solid bounds, then test brick by brick
+            glm::ivec3 chunkOrigin(cx * CHUNK_SIZE, 0, cz * CHUNK_SIZE);
+            glm::ivec3 lo = glm::max(first - chunkOrigin, node->solidMin);
+            glm::ivec3 hi = glm::min(last - chunkOrigin, node->solidMax);
+            for (int y = lo.y; y <= hi.y; ++y) {
+                for (int z = lo.z; z <= hi.z; ++z) {
+                    for (int x = lo.x; x <= hi.x; ++x) {
+                        int b = brickIndex(x / BRICK_SIZE, y / BRICK_SIZE, z / BRICK_SIZE);
+                        if (!(node->brickMask & (1ull << b))) {
+                            x |= BRICK_SIZE - 1; // Skip the rest of this empty brick's row
+                            continue;
+                        }
+                        if ((brick(*node, b) >> voxelBit(x % BRICK_SIZE, y % BRICK_SIZE, z % BRICK_SIZE)) & 1) {
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+size_t VoxelTree::memoryBytes() const {
+    return nodes.size() * (sizeof(uint64_t) + sizeof(Node)) + brickPool.capacity() * sizeof(uint64_t);
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "chunkcoord.h"
+#include "chunkmap.h"
+#include "chunkvoxels.h"
+
+#define BRICK_SIZE 4  // Voxels along each edge of a leaf brick
+#define REGION_SIZE 4 // Chunks along each edge of a region
+
+struct VoxelRay {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float maxDistance;
+};
+
+struct VoxelRayHit {
+    glm::ivec3 voxel;  // World voxel coordinates of the hit
+    glm::ivec3 normal; // Face of the voxel the ray entered through
+    float distance;    // Along the ray; negative for a miss in batch casts
+};
+
+// Sparse 64-tree over the solid voxels of the resident chunks, kept beside the
+// chunk grid as an acceleration structure. Each chunk is one node whose 64-bit
+// mask says which of its 4x4x4 bricks hold anything; occupied bricks are stored
+// packed as 64-bit voxel masks in one pool shared by all nodes, found by the
+// node's offset plus a popcount (no pointers). Above the chunks, a 16-bit mask
+// per 4x4 region of chunks marks which chunks are non-empty. Rays run an
+// Amanatides-Woo DDA over the chunk columns, reading one region mask per region
+// they enter, then over the bricks of each occupied chunk, and only step voxel
+// by voxel inside occupied bricks.
+class VoxelTree {
+public:
+    // Rebuilds the node of one chunk; cheap enough to call whenever a chunk changes
+    void update(const ChunkCoord& coord, const ChunkVoxels& voxels);
+    void remove(const ChunkCoord& coord);
+    void clear();
+
+    bool isSolid(const glm::ivec3& voxel) const;
+    // Closest solid voxel along the ray within maxDistance
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, VoxelRayHit& hit) const;
+    // Casts count rays into hits; returns how many hit something
+    int raycast(const VoxelRay* rays, int count, VoxelRayHit* hits) const;
+
+    // Tight world-space box around a chunk's solid voxels; false if it has none
+    bool chunkBounds(const ChunkCoord& coord, glm::vec3& boundsMin, glm::vec3& boundsMax) const;
+    // Whether any solid voxel intersects the world-space box
+    bool overlaps(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+
+    size_t memoryBytes() const;
+
+private:
+    struct Node {
+        uint64_t brickMask = 0;        // Bit b set if brick b has a solid voxel
+        uint32_t firstBrick = 0;       // Offset into brickPool of one voxel mask per set bit, in bit order
+        uint32_t brickCapacity = 0;    // Slots reserved there, so a chunk that doesn't grow is rewritten in place
+        glm::ivec3 solidMin, solidMax; // Local voxel bounds of the solid voxels, inclusive
+    };
+
+    static int brickIndex(int bx, int by, int bz) { return (by * BRICK_SIZE + bz) * BRICK_SIZE + bx; }
+    static int voxelBit(int x, int y, int z) { return (y * BRICK_SIZE + z) * BRICK_SIZE + x; }
+    static ChunkCoord regionOf(const ChunkCoord& coord);
+    static int regionBit(const ChunkCoord& coord);
+
+    uint64_t brick(const Node& node, int index) const;
+    // Gives up a node's slots, compacting the pool once most of it is unused
+    void freeBricks(const Node& node);
+    void compactBricks();
+    // Brick DDA through one chunk between distances t and tEnd along the shifted ray,
+    // stepping voxel by voxel only inside occupied bricks
+    bool traceChunk(const Node& node, const ChunkCoord& coord, const glm::vec3& start, const glm::vec3& dir, float t, float tEnd,
+                    const glm::ivec3& normal, VoxelRayHit& hit) const;
+
+    ChunkMap<Node> nodes;
+    ChunkMap<uint16_t> regions;
+    std::vector<uint64_t> brickPool;
+    size_t freeBrickSlots = 0; // Slots in brickPool no node uses any more
+};
@@ -0,0 +1,95 @@
+#include "workerpool.h"
+#include "framearena.h"
+
+void WorkerPool::start(unsigned int count) {
+    if (count == 0) {
+        // hardware_concurrency() may be 0 when it can't tell, so don't subtract blindly
+        unsigned int hardware = std::thread::hardware_concurrency();
+        count = hardware > 1 ? hardware - 1 : 1;
+    }
+    stopping = false;
+    for (unsigned int i = 0; i < count; ++i) {
+        threads.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+void WorkerPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    threads.clear();
+}
+
+void WorkerPool::submit(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wake.notify_one();
+}
+
+void WorkerPool::parallelFor(int count, IndexFunction function, const void* context) {
+    if (count <= 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> serial(batchMutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.function = function;
+        batch.context = context;
+        batch.count = count;
+        batch.next = 0;
+        batch.open = true;
+    }
+    if (count > 1) {
+        wake.notify_all();
+    }
+    runBatch();
+
+    // Every index is claimed now; wait for the workers still running theirs
+    std::unique_lock<std::mutex> lock(mutex);
+    batch.open = false;
+    helpersDone.wait(lock, [this]() { return batch.helpers == 0; });
+}
+
+void WorkerPool::runBatch() {
+    int i;
+    while ((i = batch.next.fetch_add(1)) < batch.count) {
+        batch.function(batch.context, i);
+    }
+}
+
+void WorkerPool::workerLoop() {
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() { return stopping || !jobs.empty() || (batch.open && batch.next.load() < batch.count); });
+            if (stopping) {
+                return;
+            }
+            // The render thread is waiting on batches, so they go before queued jobs
+            if (batch.open && batch.next.load() < batch.count) {
+                ++batch.helpers;
+                lock.unlock();
+                runBatch();
+                frameArena().reset();
+                lock.lock();
+                if (--batch.helpers == 0) {
+                    helpersDone.notify_all();
+                }
+                continue;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+        frameArena().reset(); // A job is a worker's frame
+    }
+}
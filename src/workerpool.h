@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads pulling jobs from a shared queue. Used for CPU
+// work that doesn't touch GL: voxelising chunks, building acceleration
+// structures, culling.
+class WorkerPool {
+public:
+    // 0 threads means one per hardware thread, leaving one for the render thread
+    void start(unsigned int threads = 0);
+    void stop();
+
+    void submit(std::function<void()> job);
+
+    typedef void (*IndexFunction)(const void* context, int index);
+    // Runs function(context, i) for every i in [0, count) on the workers and the
+    // calling thread, returning once all of them have finished. The batch lives in
+    // the pool rather than on the heap, so this allocates nothing; batches run one
+    // at a time, and jobs must not start one.
+    void parallelFor(int count, IndexFunction function, const void* context);
+    // Runs f(i) for every i in [0, count); f is only referenced, never copied
+    template <typename F>
+    void parallelFor(int count, const F& f) {
+        parallelFor(count, &callIndex<F>, &f);
+    }
+
+    unsigned int threadCount() const { return static_cast<unsigned int>(threads.size()); }
+
+private:
+    template <typename F>
+    static void callIndex(const void* context, int index) {
+        (*static_cast<const F*>(context))(index);
+    }
+
+    void workerLoop();
+    // Claims and runs indices of the current batch until none are left
+    void runBatch();
+
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    // The parallelFor in progress; fields other than next are written under mutex before open is set
+    struct Batch {
+        IndexFunction function = nullptr;
+        const void* context = nullptr;
+        int count = 0;
+        std::atomic<int> next{0};
+        bool open = false; // Workers may join
+        int helpers = 0;   // Workers inside runBatch()
+    };
+    Batch batch;
+    std::mutex batchMutex; // One parallelFor at a time
+    std::condition_variable helpersDone;
+};